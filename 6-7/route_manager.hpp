@@ -3,37 +3,91 @@
 
 #include <netinet/in.h>
 
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <ostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+// Routes are compiled into a byte trie, so a message is matched in one pass
+// over its path and the longest registered prefix wins. Handlers get views
+// into the message, nothing is copied.
 class RouteManager {
    public:
     using RouteHandler = std::function<void(
         const std::string &client_id, struct sockaddr_in &addr,
-        const std::string &prefix, const std::string &suffix)>;
+        std::string_view prefix, std::string_view suffix)>;
 
     void registerRoute(const std::string &prefix, RouteHandler handler) {
-        routes_[prefix] = std::move(handler);
+        uint32_t node = 0;
+        for (char c : prefix) {
+            node = findOrAddChild(node, c);
+        }
+        if (nodes_[node].handler < 0) {
+            nodes_[node].handler = static_cast<int>(handlers_.size());
+            handlers_.push_back(std::move(handler));
+        } else {
+            handlers_[nodes_[node].handler] = std::move(handler);
+        }
     }
 
     void handleRoute(const std::string &client_id, struct sockaddr_in &addr,
-                     const std::string &message) {
-        for (const auto &route : routes_) {
-            if (message.find(route.first) == 0) {
-                std::string prefix = route.first;
-                std::string suffix = message.substr(prefix.length());
-                route.second(client_id, addr, prefix, suffix);
-                return;
+                     std::string_view message) {
+        int handler = nodes_[0].handler;
+        size_t prefix_length = 0;
+        uint32_t node = 0;
+        for (size_t i = 0; i < message.size(); ++i) {
+            node = findChild(node, message[i]);
+            if (node == 0) {
+                break;
+            }
+            if (nodes_[node].handler >= 0) {
+                handler = nodes_[node].handler;
+                prefix_length = i + 1;
             }
         }
-        std::cerr << "No route found for message: " << message << std::endl;
+
+        if (handler < 0) {
+            std::cerr << "No route found for message: " << message
+                      << std::endl;
+            return;
+        }
+        handlers_[handler](client_id, addr, message.substr(0, prefix_length),
+                           message.substr(prefix_length));
     }
 
    private:
-    std::unordered_map<std::string, RouteHandler> routes_;
+    struct Node {
+        std::vector<std::pair<char, uint32_t>> children;
+        int handler = -1;
+    };
+
+    std::vector<Node> nodes_{1};
+    std::vector<RouteHandler> handlers_;
+
+    // Returns 0 (the root, which is never a child) when there is no edge.
+    uint32_t findChild(uint32_t node, char c) const {
+        for (const auto &[label, child] : nodes_[node].children) {
+            if (label == c) {
+                return child;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t findOrAddChild(uint32_t node, char c) {
+        uint32_t child = findChild(node, c);
+        if (child != 0) {
+            return child;
+        }
+        child = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[node].children.emplace_back(c, child);
+        return child;
+    }
 };
 
 #endif  // ROUTEMANAGER_HPP
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_set>
 
@@ -17,42 +18,43 @@ class Server : public UDPServer {
         routeManager.registerRoute(
             "/ping/gardener/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &) {
+                   std::string_view, std::string_view) {
                 handleGardenerPing(client_id, addr);
             });
         routeManager.registerRoute(
             "/ping/flowerbed/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &) {
+                   std::string_view, std::string_view) {
                 handleFlowerbedPing(client_id, addr);
             });
         routeManager.registerRoute(
             "/getUpdates/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &,
-                   const std::string &) { handleGetUpdates(client_id, addr); });
+                   std::string_view, std::string_view) {
+                handleGetUpdates(client_id, addr);
+            });
         routeManager.registerRoute(
             "/getFlower/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &) {
+                   std::string_view, std::string_view) {
                 handleGardenerRequest(client_id, addr);
             });
         routeManager.registerRoute(
             "/water/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &payload) {
+                   std::string_view, std::string_view payload) {
                 handleGardenerWatered(client_id, addr, payload);
             });
         routeManager.registerRoute(
             "/toWater/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &payload) {
+                   std::string_view, std::string_view payload) {
                 handleFlowerbedNewFlowers(client_id, addr, payload);
             });
         routeManager.registerRoute(
             "/monitor/",
             [this](const std::string &client_id, struct sockaddr_in &addr,
-                   const std::string &, const std::string &) {
+                   std::string_view, std::string_view) {
                 handleMonitorRequest(client_id, addr);
             });
 
@@ -75,7 +77,7 @@ class Server : public UDPServer {
 
     void handleMessage(const std::string &client_id,
                        struct sockaddr_in &client_addr,
-                       const std::string &message) override {
+                       std::string_view message) override {
         std::cout << "[INFO] Recieved { " << message << " } from " << client_id
                   << std::endl;
         routeManager.handleRoute(client_id, client_addr, message);
@@ -138,13 +140,13 @@ class Server : public UDPServer {
 
     void handleGardenerWatered(const std::string &client_id,
                                struct sockaddr_in &addr,
-                               const std::string &payload) {
+                               std::string_view payload) {
         if (!stateManager.isReady()) {
             sendMessage(client_id, addr, "NOT_READY");
             return;
         }
 
-        int flowerIndex = std::stoi(payload);
+        int flowerIndex = std::stoi(std::string(payload));
         if (flowerIndex < 0) {
             sendMessage(client_id, addr, "ERR");
             return;
@@ -155,14 +157,14 @@ class Server : public UDPServer {
 
     void handleFlowerbedNewFlowers(const std::string &client_id,
                                    struct sockaddr_in &addr,
-                                   const std::string &payload) {
+                                   std::string_view payload) {
         if (!stateManager.isReady()) {
             sendMessage(client_id, addr, "NOT_READY");
             return;
         }
         // payload is flowerIndex;...;
         std::unordered_set<size_t> newFlowers;
-        std::stringstream ss{payload};
+        std::stringstream ss{std::string(payload)};
         std::string item;
         while (std::getline(ss, item, ';')) {
             newFlowers.insert(std::stoi(item));
@@ -0,0 +1,167 @@
+#ifndef DEADLINEQUEUE_HPP
+#define DEADLINEQUEUE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Flowers of the range [first, first + count) waiting for water, ordered by
+// the time they dry out. A binary min-heap with the position of every
+// flower kept alongside in a flat array, so that a flower can be found and
+// removed from the middle: push, pop and erase are O(log n), contains is
+// O(1). The positions take 4 bytes per flower of the range, the heap grows
+// with the flowers queued; nothing is allocated per push once it has.
+class DeadlineQueue {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Clock::time_point deadline;
+        size_t flower;
+    };
+
+    explicit DeadlineQueue(size_t first = 0, size_t count = 0) {
+        reset(first, count);
+    }
+
+    // Empties the queue and makes it hold the flowers of the new range.
+    void reset(size_t first, size_t count) {
+        first_ = first;
+        heap_.clear();
+        positions_.assign(count, NOT_QUEUED);
+    }
+
+    size_t size() const { return heap_.size(); }
+    bool empty() const { return heap_.empty(); }
+
+    bool contains(size_t flower) const {
+        return inRange(flower) && positions_[flower - first_] != NOT_QUEUED;
+    }
+
+    // Returns false, keeping the earlier request, if the flower is queued
+    // or out of the range.
+    bool push(size_t flower, Clock::time_point deadline) {
+        if (!inRange(flower) || positions_[flower - first_] != NOT_QUEUED) {
+            return false;
+        }
+        positions_[flower - first_] = static_cast<uint32_t>(heap_.size());
+        heap_.push_back({deadline, flower});
+        siftUp(heap_.size() - 1);
+        return true;
+    }
+
+    // Removes and returns the flower that dries out first.
+    std::optional<Entry> pop() {
+        if (heap_.empty()) {
+            return std::nullopt;
+        }
+        Entry earliest = heap_.front();
+        removeAt(0);
+        return earliest;
+    }
+
+    bool erase(size_t flower) {
+        if (!contains(flower)) {
+            return false;
+        }
+        removeAt(positions_[flower - first_]);
+        return true;
+    }
+
+    // Appends the count entries that dry out first, in that order, without
+    // changing the queue. Walks the heap from the top, only ever looking at
+    // the children of entries already taken: O(count log count).
+    void earliest(size_t count, std::vector<Entry> &out) const {
+        thread_local std::vector<size_t> frontier;
+        frontier.clear();
+        auto later = [&](size_t a, size_t b) {
+            return before(heap_[b], heap_[a]);
+        };
+        if (!heap_.empty()) {
+            frontier.push_back(0);
+        }
+        for (; count > 0 && !frontier.empty(); --count) {
+            std::pop_heap(frontier.begin(), frontier.end(), later);
+            size_t index = frontier.back();
+            frontier.pop_back();
+            out.push_back(heap_[index]);
+            for (size_t child = 2 * index + 1;
+                 child <= 2 * index + 2 && child < heap_.size(); ++child) {
+                frontier.push_back(child);
+                std::push_heap(frontier.begin(), frontier.end(), later);
+            }
+        }
+    }
+
+   private:
+    static constexpr uint32_t NOT_QUEUED = UINT32_MAX;
+
+    size_t first_ = 0;
+    std::vector<Entry> heap_;
+    std::vector<uint32_t> positions_;  // heap index by flower - first_
+
+    bool inRange(size_t flower) const {
+        return flower >= first_ && flower - first_ < positions_.size();
+    }
+
+    static bool before(const Entry &a, const Entry &b) {
+        // Ties go to the lower flower number, so the order is deterministic.
+        return a.deadline < b.deadline ||
+               (a.deadline == b.deadline && a.flower < b.flower);
+    }
+
+    void place(size_t index, const Entry &entry) {
+        heap_[index] = entry;
+        positions_[entry.flower - first_] = static_cast<uint32_t>(index);
+    }
+
+    void removeAt(size_t index) {
+        positions_[heap_[index].flower - first_] = NOT_QUEUED;
+        Entry last = heap_.back();
+        heap_.pop_back();
+        if (index == heap_.size()) {
+            return;
+        }
+        place(index, last);
+        siftUp(index);
+        siftDown(positions_[last.flower - first_]);
+    }
+
+    void siftUp(size_t index) {
+        Entry entry = heap_[index];
+        while (index > 0) {
+            size_t parent = (index - 1) / 2;
+            if (!before(entry, heap_[parent])) {
+                break;
+            }
+            place(index, heap_[parent]);
+            index = parent;
+        }
+        place(index, entry);
+    }
+
+    void siftDown(size_t index) {
+        Entry entry = heap_[index];
+        while (true) {
+            size_t child = 2 * index + 1;
+            if (child >= heap_.size()) {
+                break;
+            }
+            if (child + 1 < heap_.size() &&
+                before(heap_[child + 1], heap_[child])) {
+                ++child;
+            }
+            if (!before(heap_[child], entry)) {
+                break;
+            }
+            place(index, heap_[child]);
+            index = child;
+        }
+        place(index, entry);
+    }
+};
+
+#endif  // DEADLINEQUEUE_HPP
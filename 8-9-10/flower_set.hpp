@@ -0,0 +1,50 @@
+#ifndef FLOWERSET_HPP
+#define FLOWERSET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of flower indices in [0, capacity) as a plain bitmap, one bit per
+// flower: a million flowers take 125 KB. Every operation is O(1).
+class FlowerSet {
+   public:
+    explicit FlowerSet(size_t capacity = 0) { resize(capacity); }
+
+    // Flowers at or above the new capacity are dropped.
+    void resize(size_t capacity) {
+        capacity_ = capacity;
+        words_.resize((capacity + 63) / 64);
+        if (capacity % 64 != 0) {
+            words_.back() &= (uint64_t{1} << (capacity % 64)) - 1;
+        }
+    }
+
+    bool contains(size_t flower) const {
+        return flower < capacity_ &&
+               (words_[flower / 64] >> (flower % 64) & 1) != 0;
+    }
+
+    // Returns false if the flower was already in the set or out of range.
+    bool insert(size_t flower) {
+        if (flower >= capacity_ || contains(flower)) {
+            return false;
+        }
+        words_[flower / 64] |= uint64_t{1} << (flower % 64);
+        return true;
+    }
+
+    bool erase(size_t flower) {
+        if (!contains(flower)) {
+            return false;
+        }
+        words_[flower / 64] &= ~(uint64_t{1} << (flower % 64));
+        return true;
+    }
+
+   private:
+    size_t capacity_ = 0;
+    std::vector<uint64_t> words_;
+};
+
+#endif  // FLOWERSET_HPP
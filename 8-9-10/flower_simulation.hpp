@@ -0,0 +1,230 @@
+#ifndef FLOWERSIMULATION_HPP
+#define FLOWERSIMULATION_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <span>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+
+#include "deadline_queue.hpp"
+
+// Server side model of the flowers: every tick each living flower dries a
+// little, at its own rate. A flower that crosses THIRSTY needs water, one
+// that crosses DEAD without being watered dies. Watering resets the dryness
+// and counts towards the flower's growth.
+//
+// Dryness is fixed point on 32 bits, THIRSTY at 2^30, so that even at a
+// millisecond tick the per-tick rates of the 10 and 60 second flowers are
+// tens of thousands apart rather than all rounding to one.
+//
+// The state is kept as parallel arrays so that a tick is one branch-free
+// pass over them, written with AVX2 on x86-64 CPUs that have it and as a
+// plain loop otherwise. The pass only marks flowers whose stage changed,
+// and those few are then handled one by one.
+class FlowerSimulation {
+   public:
+    static constexpr uint32_t THIRSTY = 0x40000000;
+    static constexpr uint32_t DEAD = 0x80000000;
+
+    struct Events {
+        std::vector<DeadlineQueue::Entry> thirsty;  // with the time they die
+        std::vector<size_t> dead;
+
+        void clear() {
+            thirsty.clear();
+            dead.clear();
+        }
+    };
+
+    // Flowers get thirsty 10 to 60 seconds after being watered.
+    FlowerSimulation(size_t flowerCount, std::chrono::milliseconds tick,
+                     uint32_t seed = std::random_device{}())
+        : tick_(tick),
+          dryness(flowerCount, 0),
+          dry_rate(flowerCount),
+          watered_count(flowerCount, 0),
+          alive(flowerCount, 1),
+          events_((flowerCount + 7) / 8 * 8, 0) {
+        auto ticksTo = [&](std::chrono::seconds after) {
+            return std::max<int64_t>(1, after / tick);
+        };
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution<uint32_t> rate_dis(
+            std::max<int64_t>(1, THIRSTY / ticksTo(std::chrono::seconds(60))),
+            std::max<int64_t>(1, THIRSTY / ticksTo(std::chrono::seconds(10))));
+        for (auto &rate : dry_rate) {
+            rate = rate_dis(gen);
+        }
+    }
+
+    size_t flowerCount() const { return dryness.size(); }
+    std::chrono::milliseconds tickPeriod() const { return tick_; }
+
+    // Safe from any thread, takes effect at the next tick.
+    void water(std::span<const size_t> flowers) {
+        std::lock_guard<std::mutex> lock(watering_mutex);
+        waterings.insert(waterings.end(), flowers.begin(), flowers.end());
+    }
+
+    // Advances every flower by one tick. Only the tick thread may call it.
+    void tick(DeadlineQueue::Clock::time_point now, Events &events) {
+        events.clear();
+        applyWaterings();
+        advance(dryness.data(), dry_rate.data(), alive.data(), events_.data(),
+                dryness.size());
+
+        // events_ is padded to whole words so it can be skipped a word at a
+        // time: almost all of it is zero.
+        for (size_t i = 0; i < dryness.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, &events_[i], sizeof(word));
+            if (word == 0) {
+                continue;
+            }
+            size_t end = std::min(i + 8, dryness.size());
+            for (size_t flower = i; flower < end; ++flower) {
+                if (events_[flower] & EVENT_DEAD) {
+                    alive[flower] = 0;
+                    events.dead.push_back(flower);
+                } else if (events_[flower] & EVENT_THIRSTY) {
+                    events.thirsty.push_back({now + untilDead(flower), flower});
+                }
+            }
+        }
+    }
+
+   private:
+    static constexpr uint8_t EVENT_THIRSTY = 1;
+    static constexpr uint8_t EVENT_DEAD = 2;
+
+    std::chrono::milliseconds tick_;
+
+    // Touched by the tick thread only.
+    std::vector<uint32_t> dryness;
+    std::vector<uint32_t> dry_rate;
+    std::vector<uint16_t> watered_count;
+    std::vector<uint8_t> alive;
+    std::vector<uint8_t> events_;
+
+    std::mutex watering_mutex;
+    std::vector<size_t> waterings;
+    std::vector<size_t> applying;
+
+    void applyWaterings() {
+        {
+            std::lock_guard<std::mutex> lock(watering_mutex);
+            std::swap(waterings, applying);
+        }
+        for (size_t flower : applying) {
+            if (flower < dryness.size() && alive[flower]) {
+                dryness[flower] = 0;
+                if (watered_count[flower] < UINT16_MAX) {
+                    ++watered_count[flower];
+                }
+            }
+        }
+        applying.clear();
+    }
+
+    std::chrono::milliseconds untilDead(size_t flower) const {
+        return tick_ * ((DEAD - dryness[flower]) / dry_rate[flower] + 1);
+    }
+
+    // The per-tick pass: dryness grows by the rate of living flowers,
+    // saturating, and the flowers that crossed a stage are marked.
+    static void advanceScalar(uint32_t *dryness, const uint32_t *rate,
+                              const uint8_t *alive, uint8_t *events,
+                              size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t before = dryness[i];
+            uint64_t after = std::min<uint64_t>(
+                before + rate[i] * uint64_t{alive[i]}, UINT32_MAX);
+            events[i] = uint8_t(before < THIRSTY && after >= THIRSTY) |
+                        uint8_t(before < DEAD && after >= DEAD) << 1;
+            dryness[i] = static_cast<uint32_t>(after);
+        }
+    }
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    // Unsigned x >= limit in every lane, as x == max(x, limit).
+    [[gnu::target("avx2"), gnu::always_inline]] static inline __m256i atLeast(
+        __m256i x, __m256i limit) {
+        return _mm256_cmpeq_epi32(_mm256_max_epu32(x, limit), x);
+    }
+
+    // The same pass eight flowers at a time.
+    [[gnu::target("avx2")]] static void advanceAvx2(uint32_t *dryness,
+                                                    const uint32_t *rate,
+                                                    const uint8_t *alive,
+                                                    uint8_t *events,
+                                                    size_t count) {
+        const __m256i thirsty = _mm256_set1_epi32(THIRSTY);
+        const __m256i dead = _mm256_set1_epi32(static_cast<int>(DEAD));
+        const __m256i thirsty_bit = _mm256_set1_epi32(EVENT_THIRSTY);
+        const __m256i dead_bit = _mm256_set1_epi32(EVENT_DEAD);
+        // Picks the low dword of each 128-bit lane, see below.
+        const __m256i low_dwords = _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i before = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(dryness + i));
+            uint64_t alive8;
+            std::memcpy(&alive8, alive + i, sizeof(alive8));
+            // 0 - alive is all ones for a living flower, zero otherwise.
+            __m256i step = _mm256_and_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rate + i)),
+                _mm256_sub_epi32(_mm256_setzero_si256(),
+                                 _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(
+                                     static_cast<long long>(alive8)))));
+            // There is no saturating 32-bit add: a sum that wrapped is below
+            // the dryness it started from, and is set to all ones.
+            __m256i sum = _mm256_add_epi32(before, step);
+            __m256i after = _mm256_or_si256(
+                sum, _mm256_xor_si256(atLeast(sum, before),
+                                      _mm256_set1_epi32(-1)));
+
+            __m256i got_thirsty = _mm256_andnot_si256(
+                atLeast(before, thirsty), atLeast(after, thirsty));
+            __m256i died = _mm256_andnot_si256(atLeast(before, dead),
+                                               atLeast(after, dead));
+            __m256i marks =
+                _mm256_or_si256(_mm256_and_si256(got_thirsty, thirsty_bit),
+                                _mm256_and_si256(died, dead_bit));
+            // Narrows the eight marks to bytes; the packs work per 128-bit
+            // lane and leave four marks in the low dword of each, the
+            // permute puts those two dwords side by side.
+            __m256i packed = _mm256_packus_epi16(
+                _mm256_packus_epi32(marks, marks), _mm256_setzero_si256());
+            packed = _mm256_permutevar8x32_epi32(packed, low_dwords);
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(events + i),
+                             _mm256_castsi256_si128(packed));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dryness + i),
+                                after);
+        }
+        advanceScalar(dryness + i, rate + i, alive + i, events + i, count - i);
+    }
+#endif
+
+    static void advance(uint32_t *dryness, const uint32_t *rate,
+                        const uint8_t *alive, uint8_t *events, size_t count) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        if (has_avx2) {
+            advanceAvx2(dryness, rate, alive, events, count);
+            return;
+        }
+#endif
+        advanceScalar(dryness, rate, alive, events, count);
+    }
+};
+
+#endif  // FLOWERSIMULATION_HPP
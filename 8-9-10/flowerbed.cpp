@@ -1,35 +1,49 @@
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdlib>
-#include <ctime>
 #include <iostream>
 #include <mutex>
 #include <ostream>
 #include <random>
-#include <sstream>
+#include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include "debug_logs.hpp"
+#include "garden_rpc.hpp"
 #include "message_parser.hpp"
+#include "session_file.hpp"
 #include "udp_client.hpp"
 
 class FlowerBedClient {
    public:
-    FlowerBedClient(const std::string& server_ip, uint16_t server_port)
-        : client(server_ip, server_port), stop_flag(false) {
-        std::srand(std::time(nullptr));
-        flower_states.resize(10, 0);
-        flower_watering_counts.resize(10, 0);
-    }
+    // The two connections are two sessions, the updates one is kept next
+    // to the session file with an ".updates" suffix.
+    FlowerBedClient(const std::string& server_ip, uint16_t server_port,
+                    const std::string& session_file = {})
+        : session(session_file),
+          updates_session(session_file.empty() ? ""
+                                               : session_file + ".updates"),
+          client(session.connect(server_ip, server_port)),
+          updates_client(updates_session.connect(server_ip, server_port)),
+          stop_flag(false) {}
 
     static constexpr size_t retryAttempts = 3;
     static constexpr uint32_t getUpdatesTimeout = 10;
+    // Used when the server gives no advice on when to call again.
     static constexpr uint32_t pingInterval = 2;
     static constexpr uint32_t newFlowersInterval = 30;
+    // Longest the server's advice is followed.
+    static constexpr auto maxPollDelay = std::chrono::minutes(2);
+    // Without a push for this long the subscription is renewed, in case
+    // the server gave up on us.
+    static constexpr auto resubscribeInterval = std::chrono::seconds(5);
 
     void start() {
-        if (!firstPing()) {
+        if (!firstPing() || !fetchFlowerCount()) {
             return;
         }
 
@@ -39,32 +53,42 @@ class FlowerBedClient {
                               std::stop_token());
 
         size_t attempts = 0;
+        auto last_push = std::chrono::steady_clock::time_point{};
 
         while (!stop_flag.load() && attempts < retryAttempts) {
             try {
-                std::optional<std::string> response;
-                {
-                    std::lock_guard<std::mutex> lock(socket_mtx);
-                    std::cout << "[INFO] Requesting updates on gardeners "
-                                 "actions on the flowerbed..."
-                              << std::endl;
-                    response =
-                        client.sendMessage("/getUpdates/", getUpdatesTimeout);
-                }
-
-                if (response.has_value()) {
-                    if (response.value() == "NOT_READY") {
-                        std::cerr << "[WARNING] Server not ready, retrying..."
-                                  << std::endl;
+                if (std::chrono::steady_clock::now() - last_push >
+                    resubscribeInterval) {
+                    if (!subscribeToUpdates()) {
                         attempts++;
                         std::this_thread::sleep_for(std::chrono::seconds(10));
-                    } else {
-                        handleServerResponse(response.value());
-                        attempts = 0;
+                        continue;
                     }
+                    attempts = 0;
+                    last_push = std::chrono::steady_clock::now();
                 }
 
-                std::this_thread::sleep_for(std::chrono::seconds(1));
+                // The pushes come on a connection of their own, so waiting
+                // for them does not hold up the pings.
+                auto push = updates_client.receivePush(1);
+                std::string_view topic, body;
+                GetUpdates::Response response;
+                if (!push || !Subscribe::splitPush(*push, topic, body) ||
+                    topic != Subscribe::UPDATES ||
+                    !BinaryCodec::readResponse(body, response)) {
+                    continue;
+                }
+                last_push = std::chrono::steady_clock::now();
+                DEBUG_LOG_BLOCK({
+                    std::cout << "[DEBUG] Pushed updates up to "
+                              << response.cursor.value_or(0) << std::endl;
+                });
+                if (response.resync) {
+                    resyncFlowerStates(response.runs);
+                } else {
+                    handleServerResponse(response.updates);
+                }
+                updates_cursor = response.cursor.value_or(updates_cursor);
             } catch (const TimeOutException& e) {
                 std::cerr << "[ERROR] Server is probably down: " << e.what()
                           << std::endl;
@@ -86,38 +110,45 @@ class FlowerBedClient {
     }
 
    private:
+    SessionFile session;
+    SessionFile updates_session;
     UDPClient client;
+    UDPClient updates_client;
     std::atomic<bool> stop_flag;
+    size_t flower_count = 0;
     std::vector<int> flower_states;
     std::vector<int> flower_watering_counts;
+    uint64_t updates_cursor = 0;
     std::mutex mtx;
     std::mutex socket_mtx;
+    // When the next ping is due; guarded by socket_mtx.
+    std::chrono::steady_clock::time_point next_heartbeat;
     std::condition_variable cv;
     std::vector<std::jthread> jthreads;
 
     bool firstPing() {
         try {
-            std::optional<std::string> response;
+            std::optional<PingFlowerbed::Response> response;
             {
                 std::lock_guard<std::mutex> lock(socket_mtx);
                 std::cout << "[INFO] Sending first ping..." << std::endl;
-                response = client.sendMessage("/ping/flowerbed/",
-                                              5);  // Timeout in seconds
+                response = rpcCall<PingFlowerbed>(client, {},
+                                                  5);  // Timeout in seconds
+                session.save(client.getSessionTicket());
             }
 
             if (response.has_value()) {
-                if (response.value() == "OK") {
-                    std::cout
-                        << "[INFO] First ping successful: " << response.value()
-                        << std::endl;
+                if (response->status == RpcStatus::Ok) {
+                    std::cout << "[INFO] First ping successful: OK"
+                              << std::endl;
                     return true;
-                } else if (response.value() == "HC") {
+                } else if (response->status == RpcStatus::AlreadyConnected) {
                     std::cerr << "[WARNING] Another flowerBed client is "
                                  "already connected."
                               << std::endl;
                 } else {
                     std::cerr << "[ERROR] Unexpected response to first ping: "
-                              << response.value() << std::endl;
+                              << rpcStatusWord(response->status) << std::endl;
                 }
             } else {
                 std::cerr << "[ERROR] No response received to first ping."
@@ -133,24 +164,98 @@ class FlowerBedClient {
         return false;
     }
 
+    // Instead of polling, the server pushes the reports after our cursor as
+    // they come in.
+    bool subscribeToUpdates() {
+        std::cout << "[INFO] Subscribing to updates on gardeners actions on "
+                     "the flowerbed..."
+                  << std::endl;
+        auto response = rpcCall<Subscribe>(
+            updates_client, {std::string(Subscribe::UPDATES), updates_cursor},
+            getUpdatesTimeout);
+        updates_session.save(updates_client.getSessionTicket());
+        if (!response.has_value()) {
+            std::cerr << "[ERROR] No response received to the subscription."
+                      << std::endl;
+            return false;
+        }
+        if (response->status != RpcStatus::Ok) {
+            std::cerr << "[WARNING] Server answered "
+                      << rpcStatusWord(response->status) << ", retrying..."
+                      << std::endl;
+            return false;
+        }
+        updates_client.expectPushes(response->first_push);
+        return true;
+    }
+
+    // The server decides how many flowers the garden has.
+    bool fetchFlowerCount() {
+        try {
+            std::optional<FlowerCount::Response> response;
+            {
+                std::lock_guard<std::mutex> lock(socket_mtx);
+                response = rpcCall<FlowerCount>(client, {}, 5);
+            }
+
+            if (response.has_value() && response->status == RpcStatus::Ok &&
+                response->count > 0) {
+                std::lock_guard<std::mutex> lock(mtx);
+                flower_count = response->count;
+                flower_states.assign(flower_count, 0);
+                flower_watering_counts.assign(flower_count, 0);
+                std::cout << "[INFO] Flowerbed has " << flower_count
+                          << " flowers" << std::endl;
+                return true;
+            }
+            std::cerr << "[ERROR] Server did not tell the number of flowers."
+                      << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] Error occured while fetching the number of "
+                         "flowers: "
+                      << e.what() << std::endl;
+        }
+
+        stop_flag.store(true);
+        return false;
+    }
+
     void pingServer(std::stop_token stop_token) {
         try {
             while (!stop_token.stop_requested() && !stop_flag.load()) {
-                std::optional<std::string> response;
+                std::optional<PingFlowerbed::Response> response;
+                std::chrono::steady_clock::time_point wake;
+                bool due;
                 {
                     std::lock_guard<std::mutex> lock(socket_mtx);
-                    std::cout << "[INFO] Pinging server..." << std::endl;
-                    response = client.sendMessage("/ping/flowerbed/", 10);
+                    // Pings also go out with the flowers to water, the
+                    // server may have heard from us since.
+                    wake = next_heartbeat;
+                    due = std::chrono::steady_clock::now() >= wake;
+                    if (due) {
+                        std::cout << "[INFO] Pinging server..." << std::endl;
+                        std::chrono::milliseconds next_poll{0};
+                        response =
+                            rpcCall<PingFlowerbed>(client, {}, 10, &next_poll);
+                        scheduleHeartbeat(response, next_poll);
+                        wake = next_heartbeat;
+                    }
+                }
+                if (!due) {
+                    std::this_thread::sleep_until(wake);
+                    continue;
                 }
 
                 if (response.has_value()) {
-                    if (response.value() == "OK" || response.value() == "HC") {
-                        std::cout
-                            << "[INFO] Ping successful: " << response.value()
-                            << std::endl;
+                    if (response->status == RpcStatus::Ok ||
+                        response->status == RpcStatus::AlreadyConnected) {
+                        std::cout << "[INFO] Ping successful: "
+                                  << rpcStatusWord(response->status)
+                                  << std::endl;
                     } else {
                         std::cerr << "[ERROR] Unexpected ping response: "
-                                  << response.value() << std::endl;
+                                  << rpcStatusWord(response->status)
+                                  << std::endl;
                         stop_flag.store(true);
                         cv.notify_all();
                         break;
@@ -163,7 +268,7 @@ class FlowerBedClient {
                     break;
                 }
 
-                std::this_thread::sleep_for(std::chrono::seconds(pingInterval));
+                std::this_thread::sleep_until(wake);
             }
         } catch (const std::exception& e) {
             std::cerr << "[ERRPR] Error occured while pinging server: "
@@ -176,51 +281,70 @@ class FlowerBedClient {
     void updateFlowerStates(std::stop_token stop_token) {
         std::mt19937 gen(std::random_device{}());
         std::uniform_int_distribution<int> dis(4, 10);
+        std::uniform_int_distribution<size_t> flower_dis(0, flower_count - 1);
+        // Flowers dry out at different rates, the server waters the ones
+        // that dry out first.
+        std::uniform_int_distribution<uint32_t> dries_in_ms_dis(10000, 60000);
 
         try {
             size_t attempts = 0;
             while (!stop_token.stop_requested() && !stop_flag.load() &&
                    attempts < retryAttempts) {
-                std::vector<int> new_flowers;
+                ToWater::Request request;
                 {
                     std::lock_guard<std::mutex> lock(mtx);
                     int num_new_flowers = dis(gen);
                     for (int i = 0; i < num_new_flowers; ++i) {
-                        int flower_index = std::rand() % 10;
-                        new_flowers.push_back(flower_index);
+                        size_t flower_index = flower_dis(gen);
+                        request.flowers.push_back(
+                            {flower_index, dries_in_ms_dis(gen)});
+                        // Asked for again, so one more watering is expected.
+                        flower_watering_counts[flower_index] = 0;
                     }
                 }
 
-                std::stringstream ss;
-                for (const auto& flower : new_flowers) {
-                    ss << flower << ";";
-                }
-
-                std::optional<std::string> response;
+                std::optional<ToWater::Response> response;
+                std::chrono::milliseconds next_poll{0};
                 {
                     std::lock_guard<std::mutex> lock(socket_mtx);
                     std::cout << "[INFO] Telling server what flowers need to "
                                  "be watered..."
                               << std::endl;
-                    DEBUG_LOG_BLOCK(
-                        { std::cout << "[DEBUG] " << ss.str() << std::endl; });
-                    response = client.sendMessage("/toWater/" + ss.str(), 10);
+                    DEBUG_LOG_BLOCK({
+                        std::cout << "[DEBUG] ";
+                        for (const auto& flower : request.flowers) {
+                            std::cout << flower.flower << ":"
+                                      << *flower.dries_in_ms << ";";
+                        }
+                        std::cout << std::endl;
+                    });
+                    // The heartbeat rides along, pingServer then skips its
+                    // next ping.
+                    RpcBatch batch;
+                    size_t ping = batch.add<PingFlowerbed>({});
+                    size_t to_water = batch.add<ToWater>(request);
+                    if (batch.send(client, 10)) {
+                        response = batch.reply<ToWater>(to_water, &next_poll);
+                        std::chrono::milliseconds ping_poll{0};
+                        scheduleHeartbeat(
+                            batch.reply<PingFlowerbed>(ping, &ping_poll),
+                            ping_poll);
+                    }
                 }
 
                 if (response.has_value()) {
-                    if (response.value() == "NOT_READY") {
+                    if (response->status == RpcStatus::NotReady) {
                         std::cout
                             << "[WARNING] Server is not ready, retrying..." << std::endl;
-                        std::unique_lock<std::mutex> lock(mtx);
-                        std::this_thread::sleep_for(
-                            std::chrono::seconds(newFlowersInterval));
+                        waitForNextRound(next_poll);
                         ++attempts;
                         continue;
                     }
-                    if (response.value() != "OK") {
+                    if (response->status != RpcStatus::Ok) {
                         std::cerr << "[ERROR] Unexpected response to pushing "
                                      "unwatered flowers: "
-                                  << response.value() << std::endl;
+                                  << rpcStatusWord(response->status)
+                                  << std::endl;
                         stop_flag.store(true);
                         cv.notify_all();
                         break;
@@ -237,9 +361,7 @@ class FlowerBedClient {
                     break;
                 }
 
-                std::unique_lock<std::mutex> lock(mtx);
-                std::this_thread::sleep_for(
-                    std::chrono::seconds(newFlowersInterval));
+                waitForNextRound(next_poll);
             }
         } catch (const std::exception& e) {
             std::cerr
@@ -250,58 +372,98 @@ class FlowerBedClient {
         }
     }
 
-    void handleServerResponse(const std::string& response) {
+    // Sets when to ping next, after a ping that was answered. Called with
+    // socket_mtx held.
+    void scheduleHeartbeat(
+        const std::optional<PingFlowerbed::Response>& response,
+        std::chrono::milliseconds advice) {
+        if (response && (response->status == RpcStatus::Ok ||
+                         response->status == RpcStatus::AlreadyConnected)) {
+            next_heartbeat =
+                std::chrono::steady_clock::now() +
+                rpcPollDelay(advice, std::chrono::seconds(pingInterval),
+                             maxPollDelay);
+        }
+    }
+
+    // Waits as long as the server advised, without holding mtx, so pushed
+    // updates keep being applied (and acknowledged) meanwhile; a stop cuts
+    // the wait short.
+    void waitForNextRound(std::chrono::milliseconds advice) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait_for(lock,
+                    rpcPollDelay(advice,
+                                 std::chrono::seconds(newFlowersInterval),
+                                 maxPollDelay),
+                    [this] { return stop_flag.load(); });
+    }
+
+    void handleServerResponse(const std::vector<FlowerUpdate>& updates) {
         DEBUG_LOG_BLOCK({
-            std::cout << "[DEBUG] Received response from server: " << response
-                      << std::endl;
+            std::cout << "[DEBUG] Received " << updates.size()
+                      << " updates from server" << std::endl;
         });
 
-        std::stringstream ss(response);
-        std::string item;
-        flower_watering_counts.resize(10, 0);
+        for (const auto& [flowerIndex, flowerState] : updates) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (flowerIndex < flower_count) {
+                flower_states[flowerIndex] = flowerState;
+                if (flowerState == 2) {
+                    // Thirsty again, the next watering is expected.
+                    flower_watering_counts[flowerIndex] = 0;
+                    continue;
+                }
+                flower_watering_counts[flowerIndex]++;
 
-        while (std::getline(ss, item, ';')) {
-            if (!item.empty()) {
-                auto pos = item.find(':');
-                if (pos != std::string::npos) {
-                    int flowerIndex = std::stoi(item.substr(0, pos));
-                    int flowerState = std::stoi(item.substr(pos + 1));
+                if (flower_watering_counts[flowerIndex] > 1) {
+                    std::cerr << "[WARNING] Flower " << flowerIndex
+                              << " was watered twice and dies." << std::endl;
+                    std::cerr << "[WARNING] Flowerbed will stop its "
+                                 "process..."
+                              << std::endl;
+                    stop_flag.store(true);
+                    cv.notify_all();
+                    break;
+                }
 
-                    std::lock_guard<std::mutex> lock(mtx);
-                    if (flowerIndex >= 0 && flowerIndex < 10) {
-                        flower_states[flowerIndex] = flowerState;
-                        flower_watering_counts[flowerIndex]++;
-
-                        if (flower_watering_counts[flowerIndex] > 1) {
-                            std::cerr << "[WARNING] Flower " << flowerIndex
-                                      << " was watered twice and dies."
-                                      << std::endl;
-                            std::cerr << "[WARNING] Flowerbed will stop its "
-                                         "process..."
-                                      << std::endl;
-                            stop_flag.store(true);
-                            cv.notify_all();
-                            break;
-                        }
+                if (flowerState == 0) {
+                    std::cerr << "[WARNING] Flower " << flowerIndex
+                              << " was not watered in time." << std::endl;
+                    std::cerr << "[WARNING] Flowerbed will stop its "
+                                 "process..."
+                              << std::endl;
 
-                        if (flowerState == 0) {
-                            std::cerr << "[WARNING] Flower " << flowerIndex
-                                      << " was not watered in time."
-                                      << std::endl;
-                            std::cerr << "[WARNING] Flowerbed will stop its "
-                                         "process..."
-                                      << std::endl;
-
-                            stop_flag.store(true);
-                            cv.notify_all();
-                            break;
-                        }
-                    }
+                    stop_flag.store(true);
+                    cv.notify_all();
+                    break;
                 }
             }
         }
     }
 
+    // The server lost track of what we have seen, it sent the latest state
+    // of every flower instead, as runs. These are not new waterings, so they
+    // are not counted, but a flower that dried out is still dead.
+    void resyncFlowerStates(const std::vector<FlowerRun>& runs) {
+        std::cerr << "[WARNING] Update log resync from server" << std::endl;
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto& [first, count, flowerState] : runs) {
+            if (first >= flower_count || count > flower_count - first) {
+                continue;
+            }
+            std::fill_n(flower_states.begin() + first, count, flowerState);
+            if (flowerState == 0) {
+                std::cerr << "[WARNING] Flower " << first
+                          << " was not watered in time." << std::endl;
+                std::cerr << "[WARNING] Flowerbed will stop its process..."
+                          << std::endl;
+                stop_flag.store(true);
+                cv.notify_all();
+                break;
+            }
+        }
+    }
+
     void stop() {
         stop_flag.store(true);
         cv.notify_all();
@@ -314,22 +476,26 @@ class FlowerBedClient {
     }
 };
 
-void clientTask(const std::string& server_ip, uint16_t server_port) {
-    FlowerBedClient client(server_ip, server_port);
+void clientTask(const std::string& server_ip, uint16_t server_port,
+                const std::string& session_file) {
+    FlowerBedClient client(server_ip, server_port, session_file);
     client.start();
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <server_ip> <server_port>"
-                  << std::endl;
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <server_ip> <server_port> [session_file]" << std::endl;
         return EXIT_FAILURE;
     }
 
     std::string server_ip = argv[1];
     uint16_t server_port = std::stoi(argv[2]);
+    // A restarted client resumes the session saved there.
+    std::string session_file = argc == 4 ? argv[3] : "";
 
-    std::thread client_thread(clientTask, server_ip, server_port);
+    std::thread client_thread(clientTask, server_ip, server_port,
+                              session_file);
     client_thread.join();
 
     return 0;
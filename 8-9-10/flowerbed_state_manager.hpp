@@ -1,62 +1,99 @@
 #ifndef FLOWERBEDSTATEMANAGER_HPP
 #define FLOWERBEDSTATEMANAGER_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "deadline_queue.hpp"
 #include "debug_logs.hpp"
+#include "flower_set.hpp"
+#include "string_hash.hpp"
 
-class FlowerBedStateManager {
+// The state is split by concern, each part behind its own lock, so that
+// handlers working on different parts never wait for each other and no lock
+// is held while a response is formatted.
+
+// How many gardeners the garden takes and how many it needs to start.
+struct GardenerPolicy {
+    size_t min_gardeners = 2;  // ready once this many are connected
+    size_t max_gardeners = 0;  // 0 for no limit
+    bool needs_flowerbed = true;
+};
+
+// Connected gardeners and flowerbed. A gardener joins, leaves and refreshes
+// its heartbeat in O(1), however many there are. Readiness is recomputed
+// whenever the registry changes and published through an atomic, so
+// checking it costs no lock.
+class ConnectionRegistry {
    public:
-    FlowerBedStateManager()
-        : gardener_count(0),
-          flowerbed_connected(false),
-          last_flowerbed_ping(std::chrono::system_clock::now()) {}
+    // A client that has not pinged for this long is dropped by the next
+    // checkConnections.
+    static constexpr auto HEARTBEAT_TIMEOUT = std::chrono::seconds(10);
+
+    explicit ConnectionRegistry(const GardenerPolicy& policy)
+        : policy(policy) {}
 
     bool setFlowerbedConnected(bool connected) {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (flowerbed_connected) {
-            last_flowerbed_ping = std::chrono::system_clock::now();
+        last_flowerbed_ping = std::chrono::system_clock::now();
+        if (flowerbed_connected.load(std::memory_order_relaxed)) {
             return false;
         }
-        last_flowerbed_ping = std::chrono::system_clock::now();
-        flowerbed_connected = connected;
+        flowerbed_connected.store(connected, std::memory_order_relaxed);
+        publishReadiness();
         return true;
     }
 
+    // Returns false if the gardener is new and the garden is full.
     bool addGardener(const std::string& client_id) {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (gardener_ids.find(client_id) != gardener_ids.end()) {
-            gardener_timestamps[client_id] = std::chrono::system_clock::now();
+        auto now = std::chrono::system_clock::now();
+        auto it = gardeners.find(client_id);
+        if (it != gardeners.end()) {
+            it->second = now;
             return true;
         }
-        if (gardener_ids.size() >= 2) {
+        if (policy.max_gardeners != 0 &&
+            gardeners.size() >= policy.max_gardeners) {
             return false;
         }
-        gardener_ids.insert(client_id);
-        gardener_timestamps[client_id] = std::chrono::system_clock::now();
-        gardener_count = gardener_ids.size();
+        gardeners.emplace(client_id, now);
+        publishReadiness();
         return true;
     }
 
-    void removeGardener(const std::string& client_id) {
+    // Returns false if the gardener was not connected.
+    bool removeGardener(const std::string& client_id) {
         std::lock_guard<std::mutex> lock(mutex_);
-        if (gardener_ids.find(client_id) == gardener_ids.end()) {
-            return;
+        if (gardeners.erase(client_id) == 0) {
+            return false;
         }
-        gardener_ids.erase(client_id);
-        gardener_timestamps.erase(client_id);
-        gardener_count = gardener_ids.size();
+        publishReadiness();
+        return true;
     }
 
     void updateGardenerTimestamp(const std::string& client_id) {
         std::lock_guard<std::mutex> lock(mutex_);
-        gardener_timestamps[client_id] = std::chrono::system_clock::now();
+        auto it = gardeners.find(client_id);
+        if (it != gardeners.end()) {
+            it->second = std::chrono::system_clock::now();
+        }
     }
 
     void updateFlowerbedTimestamp() {
@@ -64,130 +101,959 @@ class FlowerBedStateManager {
         last_flowerbed_ping = std::chrono::system_clock::now();
     }
 
-    bool isReady() {
+    // Returns true if a client was dropped.
+    bool checkConnections() {
         std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::system_clock::now();
+
+        size_t dropped = std::erase_if(gardeners, [&](const auto& kv) {
+            return now - kv.second > HEARTBEAT_TIMEOUT;
+        });
+
+        if (now - last_flowerbed_ping > HEARTBEAT_TIMEOUT &&
+            flowerbed_connected.load(std::memory_order_relaxed)) {
+            flowerbed_connected.store(false, std::memory_order_relaxed);
+            ++dropped;
+        }
+        publishReadiness();
+        return dropped > 0;
+    }
+
+    bool isReady() const { return ready.load(std::memory_order_acquire); }
+
+    int gardenerCount() const {
+        return gardener_count.load(std::memory_order_relaxed);
+    }
+
+    bool isFlowerbedConnected() const {
+        return flowerbed_connected.load(std::memory_order_relaxed);
+    }
+
+   private:
+    const GardenerPolicy policy;
+    std::mutex mutex_;
+    // Gardener id and its last heartbeat.
+    std::unordered_map<std::string, std::chrono::system_clock::time_point,
+                       StringHash, std::equal_to<>>
+        gardeners;
+    std::chrono::system_clock::time_point last_flowerbed_ping =
+        std::chrono::system_clock::now();
+
+    // Written under mutex_, read without it.
+    std::atomic<int> gardener_count{0};
+    std::atomic<bool> flowerbed_connected{false};
+    std::atomic<bool> ready{false};
+
+    void publishReadiness() {
+        int count = static_cast<int>(gardeners.size());
+        bool flowerbed = flowerbed_connected.load(std::memory_order_relaxed);
+        gardener_count.store(count, std::memory_order_relaxed);
+        ready.store((flowerbed || !policy.needs_flowerbed) &&
+                        gardeners.size() >= policy.min_gardeners,
+                    std::memory_order_release);
         DEBUG_LOG_BLOCK({
-            std::cout << "flowerbed_connected: " << flowerbed_connected
-                      << std::endl;
-            std::cout << "gardener_count: " << gardener_count << std::endl;
+            std::cout << "flowerbed_connected: " << flowerbed << std::endl;
+            std::cout << "gardener_count: " << count << std::endl;
         });
-        return flowerbed_connected && gardener_count >= 2;
     }
+};
+
+// Work for the gardeners over a fixed number of flowers: the flowers the
+// flowerbed asked to water that no gardener has taken yet, handed out
+// earliest deadline first, and the flowers already watered since the
+// flowerbed last asked for them.
+//
+// A flower handed out is leased to the gardener for LEASE_TIME rather than
+// forgotten. Its /water/ report ends the lease; a lease that runs out, the
+// gardener having crashed or its report lost, puts the flower back in the
+// queue with its original deadline, ahead of everything that dries out
+// later. Leases all last the same time, so they expire in the order they
+// were granted and a FIFO serves as their timer queue.
+//
+// The flowers are split into contiguous ranges, each a shard with its own
+// lock, and every gardener is hashed to a home shard. A gardener takes work
+// from its home shard and only looks at the others when that one is empty,
+// so with many gardeners they rarely meet on a lock. Deadlines are ordered
+// within a shard.
+class WorkQueue {
+   public:
+    using Clock = DeadlineQueue::Clock;
+
+    // Upper bound on the flowers listed in a monitor snapshot.
+    static constexpr size_t PENDING_SAMPLE = 64;
+    static constexpr size_t MAX_SHARDS = 64;
+    static constexpr size_t MIN_SHARD_FLOWERS = 1024;
+    static constexpr auto LEASE_TIME = std::chrono::seconds(10);
+
+    // Gets the flowers leased to a parked request, or none once its wait
+    // ran out. Called on whichever thread found them, with no lock held.
+    using Completion = std::function<void(std::span<const size_t>)>;
+
+    struct Stats {
+        size_t waiting = 0;
+        size_t leased = 0;
+        uint64_t requeued = 0;  // leases that ran out, since the start
+    };
+
+    explicit WorkQueue(size_t flowerCount)
+        : flower_count(flowerCount),
+          shard_count(std::clamp<size_t>(flowerCount / MIN_SHARD_FLOWERS, 1,
+                                         MAX_SHARDS)),
+          shard_size((flowerCount + shard_count - 1) / shard_count),
+          shards(shard_count) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            shards[i].begin = i * shard_size;
+            size_t count = std::min(shard_size, flowerCount - shards[i].begin);
+            shards[i].needs_water.reset(shards[i].begin, count);
+            shards[i].watered.resize(count);
+            shards[i].dead.resize(count);
+        }
+    }
+
+    size_t flowerCount() const { return flower_count; }
+
+    // Flowers waiting or leased, from the shards' counters without taking
+    // a lock: a cheap, possibly slightly stale, measure of the work left.
+    size_t backlog() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            total += shard.active.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // Leases up to count flowers, those that dry out first in the gardener's
+    // home shard, then in the next shards that have work. Each shard is
+    // locked once.
+    void getFlowersToWater(std::string_view gardener, size_t count,
+                           std::vector<size_t>& flowers) {
+        flowers.clear();
+        auto now = Clock::now();
+        size_t home = homeShard(gardener);
+        for (size_t i = 0; i < shard_count && flowers.size() < count; ++i) {
+            Shard& shard = shards[(home + i) % shard_count];
+            if (shard.active.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.requeueExpired(now);
+            while (flowers.size() < count) {
+                auto entry = shard.needs_water.pop();
+                if (!entry) {
+                    break;
+                }
+                shard.grantLease(entry->flower, entry->deadline, now);
+                flowers.push_back(entry->flower);
+            }
+        }
+        if (!flowers.empty()) {
+            granted.fetch_add(flowers.size(), std::memory_order_relaxed);
+        }
+    }
+
+    // Flowers leased since the start, by any path: a caller compares it
+    // before and after a call that may hand work to parked requests.
+    uint64_t grants() const { return granted.load(std::memory_order_relaxed); }
+
+    // Returns false, adding nothing, if a flower is out of range. A flower
+    // that is already waiting keeps its place and deadline, one that is
+    // leased or dead is not queued again.
+    bool addFlowersToWater(std::span<const DeadlineQueue::Entry> flowers) {
+        if (std::any_of(flowers.begin(), flowers.end(), [&](const auto& e) {
+                return e.flower >= flower_count;
+            })) {
+            return false;
+        }
+        for (const auto& [deadline, flower] : flowers) {
+            Shard& shard = shardOf(flower);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (shard.dead.contains(flower - shard.begin)) {
+                continue;
+            }
+            if (!shard.leases.contains(flower)) {
+                shard.needs_water.push(flower, deadline);
+            }
+            shard.watered.erase(flower - shard.begin);
+            shard.updateActive();
+        }
+        wakeWaiters();
+        return true;
+    }
+
+    // Like getFlowersToWater, but if there is nothing to do the request is
+    // parked in the gardener's home shard and completed as soon as flowers
+    // are added, or with none at expires. Returns false if it was parked;
+    // the completion may have run by then.
+    bool getFlowersOrWait(std::string_view gardener, size_t count,
+                          Clock::time_point expires,
+                          std::vector<size_t>& flowers, Completion complete) {
+        getFlowersToWater(gardener, count, flowers);
+        if (!flowers.empty()) {
+            return true;
+        }
+        Shard& home = shards[homeShard(gardener)];
+        {
+            std::lock_guard<std::mutex> lock(home.mutex);
+            home.waiters.push_back(
+                {std::string(gardener), count, expires, std::move(complete)});
+            home.waiting.store(home.waiters.size(), std::memory_order_relaxed);
+        }
+        // Flowers added since the attempt above did not see this request.
+        wakeWaiters();
+        return false;
+    }
+
+    // Completes, with no flowers, the parked requests whose wait ran out.
+    void expireWaiters(Clock::time_point now) {
+        std::vector<Waiter> expired;
+        for (auto& shard : shards) {
+            if (shard.waiting.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto end = std::stable_partition(
+                shard.waiters.begin(), shard.waiters.end(),
+                [&](const Waiter& waiter) { return waiter.expires > now; });
+            std::move(end, shard.waiters.end(), std::back_inserter(expired));
+            shard.waiters.erase(end, shard.waiters.end());
+            shard.waiting.store(shard.waiters.size(),
+                                std::memory_order_relaxed);
+        }
+        for (auto& waiter : expired) {
+            waiter.complete({});
+        }
+    }
+
+    // Ends the leases of the flowers and appends to newly those not yet
+    // reported watered since the flowerbed last asked for them, so a
+    // retried report is not counted twice. Dead flowers are skipped, they
+    // are past watering. Each shard is locked once.
+    void markWatered(std::span<const size_t> flowers,
+                     std::vector<size_t>& newly) {
+        // Reused by the handler thread, sorting needs a copy.
+        thread_local std::vector<size_t> sorted;
+        sorted.assign(flowers.begin(), flowers.end());
+        std::sort(sorted.begin(), sorted.end());
+        std::unique_lock<std::mutex> lock;
+        Shard* locked = nullptr;
+        for (size_t flower : sorted) {
+            Shard& shard = shardOf(flower);
+            if (&shard != locked) {
+                if (locked) {
+                    locked->updateActive();
+                }
+                lock = std::unique_lock<std::mutex>(shard.mutex);
+                locked = &shard;
+            }
+            if (shard.dead.contains(flower - shard.begin)) {
+                continue;
+            }
+            shard.needs_water.erase(flower);
+            shard.leases.erase(flower);
+            if (shard.watered.insert(flower - shard.begin)) {
+                newly.push_back(flower);
+            }
+        }
+        if (locked) {
+            locked->updateActive();
+        }
+    }
+
+    // Dead flowers need no more water, and are remembered so that they are
+    // neither queued nor reported watered again.
+    void drop(std::span<const size_t> flowers) {
+        for (size_t flower : flowers) {
+            Shard& shard = shardOf(flower);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.dead.insert(flower - shard.begin);
+            shard.needs_water.erase(flower);
+            shard.leases.erase(flower);
+            shard.updateActive();
+        }
+    }
+
+    // Requeues the flowers of every lease that ran out. Returns how many.
+    size_t requeueExpired() {
+        auto now = Clock::now();
+        size_t requeued = 0;
+        for (auto& shard : shards) {
+            if (shard.active.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            requeued += shard.requeueExpired(now);
+        }
+        if (requeued > 0) {
+            wakeWaiters();
+        }
+        return requeued;
+    }
+
+    // Totals from the shards' counters, without taking a lock.
+    Stats totals() const {
+        Stats stats;
+        for (const auto& shard : shards) {
+            size_t active = shard.active.load(std::memory_order_relaxed);
+            size_t leased = shard.leased.load(std::memory_order_relaxed);
+            stats.waiting += active - std::min(active, leased);
+            stats.leased += leased;
+            stats.requeued += shard.requeued.load(std::memory_order_relaxed);
+        }
+        return stats;
+    }
+
+    // Up to PENDING_SAMPLE of the most urgent waiting flowers, earliest
+    // deadline first, and the totals. Takes the most urgent of every shard
+    // and picks among those. Locks every shard with work, so it is for
+    // monitor snapshots only.
+    Stats pending(std::vector<size_t>& sample) {
+        sample.clear();
+        thread_local std::vector<DeadlineQueue::Entry> urgent;
+        urgent.clear();
+        for (auto& shard : shards) {
+            if (shard.active.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.needs_water.earliest(PENDING_SAMPLE, urgent);
+        }
+        Stats stats = totals();
+        auto by_deadline = [](const auto& a, const auto& b) {
+            return a.deadline != b.deadline ? a.deadline < b.deadline
+                                            : a.flower < b.flower;
+        };
+        size_t shown = std::min(urgent.size(), PENDING_SAMPLE);
+        std::partial_sort(urgent.begin(), urgent.begin() + shown, urgent.end(),
+                          by_deadline);
+        for (size_t i = 0; i < shown; ++i) {
+            sample.push_back(urgent[i].flower);
+        }
+        return stats;
+    }
+
+   private:
+    struct Lease {
+        Clock::time_point deadline;  // of the flower, kept for the requeue
+        uint64_t id;
+    };
+
+    struct LeaseTimer {
+        Clock::time_point expires;
+        size_t flower;
+        uint64_t id;  // a timer whose lease has ended is skipped
+    };
+
+    struct Waiter {
+        std::string gardener;
+        size_t count;
+        Clock::time_point expires;
+        Completion complete;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        size_t begin = 0;  // first flower of the range
+        DeadlineQueue needs_water;
+        FlowerSet watered;  // indexed from begin
+        FlowerSet dead;     // indexed from begin
+        // Leases come and go with every request; their nodes and timer
+        // blocks are recycled through the shard's pool, used under mutex
+        // only.
+        std::pmr::unsynchronized_pool_resource lease_pool;
+        std::pmr::unordered_map<size_t, Lease> leases{&lease_pool};
+        std::pmr::deque<LeaseTimer> lease_timers{&lease_pool};
+        uint64_t next_lease = 0;
+        // Flowers waiting or leased, readable without the lock to skip idle
+        // shards, and how many of them are leased, for the totals.
+        std::atomic<size_t> active{0};
+        std::atomic<size_t> leased{0};
+        std::atomic<uint64_t> requeued{0};
+        // Requests of the gardeners homed here, parked until there is work.
+        std::vector<Waiter> waiters;
+        std::atomic<size_t> waiting{0};
+
+        void updateActive() {
+            active.store(needs_water.size() + leases.size(),
+                         std::memory_order_relaxed);
+            leased.store(leases.size(), std::memory_order_relaxed);
+        }
+
+        void grantLease(size_t flower, Clock::time_point deadline,
+                        Clock::time_point now) {
+            uint64_t id = next_lease++;
+            leases[flower] = {deadline, id};
+            lease_timers.push_back({now + LEASE_TIME, flower, id});
+            updateActive();
+        }
+
+        // Also drops the timers of ended leases from the front, expired or
+        // not, so that the FIFO holds about as many timers as there are
+        // leases rather than every lease of the last LEASE_TIME.
+        size_t requeueExpired(Clock::time_point now) {
+            size_t count = 0;
+            while (!lease_timers.empty()) {
+                LeaseTimer timer = lease_timers.front();
+                auto it = leases.find(timer.flower);
+                bool ended = it == leases.end() || it->second.id != timer.id;
+                if (!ended && timer.expires > now) {
+                    break;
+                }
+                lease_timers.pop_front();
+                if (ended) {
+                    continue;
+                }
+                needs_water.push(timer.flower, it->second.deadline);
+                leases.erase(it);
+                ++count;
+            }
+            if (count > 0) {
+                requeued.fetch_add(count, std::memory_order_relaxed);
+                updateActive();
+            }
+            return count;
+        }
+    };
+
+    const size_t flower_count;
+    const size_t shard_count;
+    const size_t shard_size;
+    std::vector<Shard> shards;
+    std::atomic<uint64_t> granted{0};
+
+    Shard& shardOf(size_t flower) { return shards[flower / shard_size]; }
+
+    size_t homeShard(std::string_view gardener) const {
+        return std::hash<std::string_view>{}(gardener) % shard_count;
+    }
+
+    // Hands work to parked requests, oldest first in every shard, until one
+    // finds nothing. A shard's requests are taken out while they are served,
+    // so no two locks are ever held. Returns how many were completed.
+    size_t wakeWaiters() {
+        size_t woken = 0;
+        std::vector<size_t> flowers;
+        for (auto& shard : shards) {
+            if (shard.waiting.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+            std::vector<Waiter> parked;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                parked.swap(shard.waiters);
+                shard.waiting.store(0, std::memory_order_relaxed);
+            }
+            auto served = parked.begin();
+            for (; served != parked.end(); ++served) {
+                getFlowersToWater(served->gardener, served->count, flowers);
+                if (flowers.empty()) {
+                    break;
+                }
+                served->complete(flowers);
+                ++woken;
+            }
+            bool exhausted = served != parked.end();
+            if (exhausted) {
+                // Parked again ahead of any that came in meanwhile.
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.waiters.insert(shard.waiters.begin(),
+                                     std::make_move_iterator(served),
+                                     std::make_move_iterator(parked.end()));
+                shard.waiting.store(shard.waiters.size(),
+                                    std::memory_order_relaxed);
+                break;
+            }
+        }
+        return woken;
+    }
+};
+
+// Watering reports from the gardeners, kept in a bounded ring. Every report
+// gets the next sequence number and readers pass the number of the last
+// report they have seen, so a retried read returns the same reports again
+// instead of losing them. A reader whose cursor has already been overwritten
+// gets a resync: the latest state of every flower, as runs of neighbouring
+// flowers in the same state. The latest states take a byte per flower.
+class UpdateLog {
+   public:
+    using Update = std::pair<size_t, int>;
+
+    // Flowers [first, first + count) are all in state.
+    struct Run {
+        size_t first;
+        size_t count;
+        int state;
+    };
+
+    struct ReadResult {
+        uint64_t cursor;  // sequence number of the newest report handed out
+        bool resync;
+    };
+
+    static constexpr size_t CAPACITY = 1024;
+
+    // Flowers are numbered below flowerCount, states are small: 0 to 2.
+    explicit UpdateLog(size_t flowerCount)
+        : ring(CAPACITY), latest_states(flowerCount, NO_STATE) {}
 
     void addUpdate(size_t flowerIndex, int flowerState) {
         std::lock_guard<std::mutex> lock(mutex_);
-        updates.emplace_back(flowerIndex, flowerState);
+        ring[next_seq % CAPACITY] = {next_seq, {flowerIndex, flowerState}};
+        ++next_seq;
+        latest_states[flowerIndex] = static_cast<uint8_t>(flowerState);
     }
 
-    std::vector<std::pair<size_t, int>> getUpdates() {
+    void addUpdates(std::span<const size_t> flowers, int flowerState) {
         std::lock_guard<std::mutex> lock(mutex_);
-        return updates;
+        for (size_t flowerIndex : flowers) {
+            ring[next_seq % CAPACITY] = {next_seq, {flowerIndex, flowerState}};
+            ++next_seq;
+            latest_states[flowerIndex] = static_cast<uint8_t>(flowerState);
+        }
     }
 
-    void clearUpdates() {
+    // Replaces the contents of updates with the reports after cursor, or,
+    // on a resync, the contents of runs with the latest states of the
+    // flowers ever reported.
+    ReadResult readSince(uint64_t cursor, std::vector<Update>& updates,
+                         std::vector<Run>& runs) {
+        updates.clear();
+        runs.clear();
         std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t head = next_seq - 1;
+        if (cursor > head || cursor + 1 < oldestSeq()) {
+            stateRuns(runs);
+            acknowledge(head);
+            return {head, true};
+        }
+        acknowledge(cursor);
+        copyAfter(cursor, updates);
+        return {head, false};
+    }
+
+    // For clients that do not track a cursor: the log remembers how far it
+    // got for each of them, which gives them the old draining behavior.
+    ReadResult readForClient(const std::string& client_id,
+                             std::vector<Update>& updates) {
         updates.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(client_cursors, [&](const auto& kv) {
+            return now - kv.second.last_read > CLIENT_CURSOR_TIMEOUT;
+        });
+
+        auto it =
+            client_cursors.try_emplace(client_id, ClientCursor{confirmed()})
+                .first;
+        uint64_t head = next_seq - 1;
+        uint64_t cursor = std::max(it->second.cursor, oldestSeq() - 1);
+        copyAfter(std::min(cursor, head), updates);
+        it->second = {head, now};
+        acknowledge(head);
+        return {head, false};
     }
 
-    void checkConnections() {
+    // The reports up to cursor reached their reader by other means, a push.
+    void confirm(uint64_t cursor) {
         std::lock_guard<std::mutex> lock(mutex_);
-        auto now = std::chrono::system_clock::now();
-        auto timeout = std::chrono::seconds(10);
+        acknowledge(std::min(cursor, next_seq - 1));
+    }
 
-        std::erase_if(gardener_ids, [&](const std::string& id) {
-            return now - gardener_timestamps[id] > timeout;
-        });
+    // Sequence number of the newest report some reader has seen, without
+    // taking the lock. It only grows.
+    uint64_t confirmed() const {
+        return acknowledged.load(std::memory_order_relaxed);
+    }
 
-        std::erase_if(gardener_timestamps, [&](const auto& kv) {
-            return now - kv.second > timeout;
-        });
+    // Sequence number of the newest report, 0 if there is none.
+    uint64_t head() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_seq - 1;
+    }
+
+    // Replaces the contents of flowers with those of the reports no reader
+    // has confirmed yet.
+    void wateredFlowers(std::vector<size_t>& flowers) {
+        flowers.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t from = std::max(confirmed(), oldestSeq() - 1);
+        for (uint64_t seq = from + 1; seq < next_seq; ++seq) {
+            flowers.push_back(ring[seq % CAPACITY].update.first);
+        }
+    }
+
+   private:
+    struct Entry {
+        uint64_t seq = 0;
+        Update update;
+    };
+
+    struct ClientCursor {
+        uint64_t cursor = 0;
+        std::chrono::steady_clock::time_point last_read =
+            std::chrono::steady_clock::now();
+    };
 
-        gardener_count = gardener_ids.size();
+    static constexpr auto CLIENT_CURSOR_TIMEOUT = std::chrono::seconds(60);
+    // In latest_states for a flower no report was about.
+    static constexpr uint8_t NO_STATE = UINT8_MAX;
+
+    std::mutex mutex_;
+    std::vector<Entry> ring;
+    uint64_t next_seq = 1;
+    // Written under mutex_ only.
+    std::atomic<uint64_t> acknowledged{0};
+    std::vector<uint8_t> latest_states;
+    std::unordered_map<std::string, ClientCursor> client_cursors;
 
-        if (now - last_flowerbed_ping > timeout) {
-            flowerbed_connected = false;
+    void acknowledge(uint64_t seq) {
+        if (seq > confirmed()) {
+            acknowledged.store(seq, std::memory_order_relaxed);
         }
     }
 
-    int getFlowerToWater() {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (flowersToWater.empty()) {
-            return -1;
+    uint64_t oldestSeq() const {
+        return next_seq > CAPACITY ? next_seq - CAPACITY : 1;
+    }
+
+    void stateRuns(std::vector<Run>& runs) const {
+        for (size_t flower = 0; flower < latest_states.size(); ++flower) {
+            uint8_t state = latest_states[flower];
+            if (state == NO_STATE) {
+                continue;
+            }
+            if (!runs.empty() && runs.back().state == state &&
+                runs.back().first + runs.back().count == flower) {
+                ++runs.back().count;
+            } else {
+                runs.push_back({flower, 1, state});
+            }
         }
-        size_t flowerIndex = *flowersToWater.begin();
-        flowersToWater.erase(flowerIndex);
-        return flowerIndex;
     }
 
-    void addFlowersToWater(std::unordered_set<size_t> newFlowersToWater) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        flowersToWater.insert(newFlowersToWater.begin(),
-                              newFlowersToWater.end());
+    void copyAfter(uint64_t cursor, std::vector<Update>& updates) const {
+        for (uint64_t seq = cursor + 1; seq < next_seq; ++seq) {
+            updates.push_back(ring[seq % CAPACITY].update);
+        }
     }
+};
 
-    void updateNonitorConnection(std::string monitorClientId) {
+// Monitors that polled within the last ten seconds.
+class MonitorRegistry {
+   public:
+    // Monitor id and the time it connected. The report shows when a monitor
+    // connected rather than when it last polled, which would change the
+    // state on every poll.
+    using Entry = std::pair<std::string, std::chrono::system_clock::time_point>;
+
+    // Returns true if the set of connected monitors changed. A poll from an
+    // already connected monitor only refreshes its deadline.
+    bool updateConnection(const std::string& monitorClientId) {
         std::lock_guard<std::mutex> lock(mutex_);
-        connected_monitors[monitorClientId] = std::chrono::system_clock::now();
-        auto deadline =
-            std::chrono::system_clock::now() - std::chrono::seconds(10);
-        std::erase_if(connected_monitors,
-                      [&](const auto& kv) { return kv.second < deadline; });
+        auto now = std::chrono::system_clock::now();
+        auto [it, inserted] =
+            connected_monitors.try_emplace(monitorClientId, Times{now, now});
+        it->second.last_seen = now;
+        auto deadline = now - std::chrono::seconds(10);
+        size_t expired = std::erase_if(connected_monitors, [&](const auto& kv) {
+            return kv.second.last_seen < deadline;
+        });
+        return inserted || expired > 0;
     }
 
-    std::string getMonitorData() {
+    // Replaces the contents of entries, reusing their strings.
+    void connected(std::vector<Entry>& entries) {
         std::lock_guard<std::mutex> lock(mutex_);
-        std::string info = "";
-        info += "Gardeners connected: " + std::to_string(gardener_count) + "\n";
-        info += "Flowerbed connected: " + std::to_string(flowerbed_connected) +
-                "\n";
+        entries.resize(connected_monitors.size());
+        auto entry = entries.begin();
+        for (const auto& [clientId, times] : connected_monitors) {
+            entry->first.assign(clientId);
+            entry->second = times.connected_since;
+            ++entry;
+        }
+    }
+
+   private:
+    struct Times {
+        std::chrono::system_clock::time_point connected_since;
+        std::chrono::system_clock::time_point last_seen;
+    };
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Times> connected_monitors;
+};
+
+// Immutable copy of the state shown to monitors. Changes only mark the
+// published one stale; the next one is gathered, with the next version
+// number, by whoever asks for it first: the push thread, or a monitor's
+// request. So a burst of changes costs one snapshot, and the gardener and
+// flowerbed requests that cause the changes never build one.
+class MonitorSnapshot {
+   public:
+    uint64_t version = 0;
+    int gardener_count = 0;
+    bool flowerbed_connected = false;
+    std::vector<size_t> flowers_to_water;  // a sample, see WorkQueue
+    size_t flowers_to_water_total = 0;
+    size_t flowers_leased = 0;
+    uint64_t leases_requeued = 0;
+    std::vector<size_t> watered_flowers;
+    std::vector<MonitorRegistry::Entry> monitors;
+};
+
+class FlowerBedStateManager {
+   public:
+    explicit FlowerBedStateManager(size_t flowerCount,
+                                   const GardenerPolicy& policy = {})
+        : connections(policy),
+          workQueue(flowerCount),
+          updateLog(flowerCount) {
+        publishSnapshot();
+    }
 
-        info += "Flowers to water: ";
-        for (auto flower : flowersToWater) {
-            info += std::to_string(flower) + " ";
+    size_t flowerCount() const { return workQueue.flowerCount(); }
+
+    bool setFlowerbedConnected(bool connected) {
+        if (!connections.setFlowerbedConnected(connected)) {
+            return false;
         }
-        info += "\n";
+        markChanged();
+        return true;
+    }
 
-        info += "Updates from gardeners (watered flowers):";
-        if (updates.empty()) {
-            info += "None";
-        } else {
-            info += "\n\t";
-            for (auto update : updates) {
-                info += std::to_string(update.first) + " ";
-            }
+    bool addGardener(const std::string& client_id) {
+        int gardeners = connections.gardenerCount();
+        bool added = connections.addGardener(client_id);
+        if (connections.gardenerCount() != gardeners) {
+            markChanged();
         }
+        return added;
+    }
 
-        info += "\n";
+    void removeGardener(const std::string& client_id) {
+        if (connections.removeGardener(client_id)) {
+            markChanged();
+        }
+    }
 
-        info += "Connected monitors: ";
-        if (connected_monitors.empty()) {
-            info += "None\n";
-        } else {
-            info += "\n\t";
-            for (const auto& [clientId, timestamp] : connected_monitors) {
-                auto timet = std::chrono::system_clock::to_time_t(timestamp);
-                auto tm = std::localtime(&timet);
-                char buffer[32] = {0};
-                std::strftime(buffer, 32, "%Y-%m-%d %H:%M:%S", tm);
-                info += clientId + "\t last update: " + buffer + "\n\t";
-            }
+    void updateGardenerTimestamp(const std::string& client_id) {
+        connections.updateGardenerTimestamp(client_id);
+    }
+
+    void updateFlowerbedTimestamp() { connections.updateFlowerbedTimestamp(); }
+
+    bool isReady() const { return connections.isReady(); }
+
+    int gardenerCount() const { return connections.gardenerCount(); }
+
+    size_t backlog() const { return workQueue.backlog(); }
+
+    // Returns false, applying nothing, if a flower is out of range. A
+    // repeated report of the same watering is accepted but not logged again,
+    // nor is the watering of a dead flower; newly gets the flowers that
+    // were logged.
+    bool reportWatered(std::span<const size_t> flowers,
+                       std::vector<size_t>& newly) {
+        newly.clear();
+        size_t count = flowerCount();
+        if (std::any_of(flowers.begin(), flowers.end(),
+                        [&](size_t flower) { return flower >= count; })) {
+            return false;
+        }
+        workQueue.markWatered(flowers, newly);
+        if (!newly.empty()) {
+            updateLog.addUpdates(newly, 1);
+            markChanged();
+        }
+        return true;
+    }
+
+    // Flowers the simulation found thirsty are queued for the gardeners and
+    // reported to the flowerbed with state 2, so that watering them again
+    // is expected.
+    void reportThirsty(std::span<const DeadlineQueue::Entry> flowers) {
+        if (flowers.empty() || !workQueue.addFlowersToWater(flowers)) {
+            return;
+        }
+        for (const auto& entry : flowers) {
+            updateLog.addUpdate(entry.flower, 2);
+        }
+        markChanged();
+    }
+
+    // Flowers that dried out are reported to the flowerbed with state 0.
+    void reportDead(std::span<const size_t> flowers) {
+        if (flowers.empty()) {
+            return;
+        }
+        workQueue.drop(flowers);
+        updateLog.addUpdates(flowers, 0);
+        markChanged();
+    }
+
+    UpdateLog::ReadResult readUpdates(uint64_t cursor,
+                                      std::vector<UpdateLog::Update>& updates,
+                                      std::vector<UpdateLog::Run>& runs) {
+        uint64_t confirmed = updateLog.confirmed();
+        auto result = updateLog.readSince(cursor, updates, runs);
+        if (updateLog.confirmed() != confirmed) {
+            markChanged();
+        }
+        return result;
+    }
+
+    UpdateLog::ReadResult readUpdates(const std::string& client_id,
+                                      std::vector<UpdateLog::Update>& updates) {
+        uint64_t confirmed = updateLog.confirmed();
+        auto result = updateLog.readForClient(client_id, updates);
+        if (updateLog.confirmed() != confirmed) {
+            markChanged();
+        }
+        return result;
+    }
+
+    uint64_t updatesHead() { return updateLog.head(); }
+
+    void confirmUpdates(uint64_t cursor) {
+        uint64_t confirmed = updateLog.confirmed();
+        updateLog.confirm(cursor);
+        if (updateLog.confirmed() != confirmed) {
+            markChanged();
+        }
+    }
+
+    // Also gives back the flowers whose lease ran out, in case no gardener
+    // asks for work to trigger that.
+    void checkConnections() {
+        bool dropped = connections.checkConnections();
+        if (workQueue.requeueExpired() > 0 || dropped) {
+            markChanged();
+        }
+    }
+
+    void getFlowersToWater(std::string_view gardener, size_t count,
+                           std::vector<size_t>& flowers) {
+        workQueue.getFlowersToWater(gardener, count, flowers);
+        if (!flowers.empty()) {
+            markChanged();
+        }
+    }
+
+    // Returns false if the request was parked, see WorkQueue.
+    bool getFlowersOrWait(std::string_view gardener, size_t count,
+                          std::chrono::milliseconds wait,
+                          std::vector<size_t>& flowers,
+                          WorkQueue::Completion complete) {
+        // A parked request, this one or another, may be completed before
+        // the call returns, leasing flowers all the same.
+        uint64_t grants = workQueue.grants();
+        bool got = workQueue.getFlowersOrWait(
+            gardener, count, WorkQueue::Clock::now() + wait, flowers,
+            std::move(complete));
+        if (workQueue.grants() != grants) {
+            markChanged();
+        }
+        return got;
+    }
+
+    void expireWaiters() { workQueue.expireWaiters(WorkQueue::Clock::now()); }
+
+    bool addFlowersToWater(std::span<const DeadlineQueue::Entry> flowers) {
+        if (!workQueue.addFlowersToWater(flowers)) {
+            return false;
+        }
+        markChanged();
+        return true;
+    }
+
+    void updateNonitorConnection(const std::string& monitorClientId) {
+        if (monitors.updateConnection(monitorClientId)) {
+            markChanged();
         }
+    }
 
-        return info;
+    // Returns the latest snapshot, gathering a new one first if the state
+    // changed since. Readers keep a snapshot alive for as long as they use
+    // it, however many versions follow.
+    std::shared_ptr<const MonitorSnapshot> getMonitorSnapshot() {
+        if (stale.load(std::memory_order_acquire)) {
+            publishSnapshot();
+        }
+        return snapshot.load(std::memory_order_acquire);
+    }
+
+    // Waits until the state changed since the snapshot of version, or for at
+    // most timeout, and returns the latest snapshot.
+    std::shared_ptr<const MonitorSnapshot> waitForSnapshot(
+        uint64_t version, std::chrono::milliseconds timeout) {
+        {
+            std::unique_lock<std::mutex> lock(change_mutex);
+            changed.wait_for(lock, timeout, [&] {
+                return stale.load(std::memory_order_acquire) ||
+                       snapshot.load(std::memory_order_acquire)->version >
+                           version;
+            });
+        }
+        return getMonitorSnapshot();
     }
 
    private:
-    int gardener_count;
-    bool flowerbed_connected;
-    std::unordered_set<std::string> gardener_ids;
-    std::unordered_map<std::string, std::chrono::system_clock::time_point>
-        gardener_timestamps;
-    std::chrono::system_clock::time_point last_flowerbed_ping;
-    std::mutex mutex_;
-    std::vector<std::pair<size_t, int>> updates;
-    std::unordered_map<std::string, std::chrono::system_clock::time_point>
-        connected_monitors;
-    std::unordered_set<size_t> flowersToWater;
+    ConnectionRegistry connections;
+    WorkQueue workQueue;
+    UpdateLog updateLog;
+    MonitorRegistry monitors;
+
+    // Set by every change monitors can see, cleared by the publisher that
+    // gathers it. Only the change that finds it clear takes change_mutex to
+    // wake a waiter, the rest cost one atomic exchange. Set at first so the
+    // constructor publishes.
+    std::atomic<bool> stale{true};
+    std::mutex change_mutex;
+    std::condition_variable changed;
+
+    // Publishers are serialized, so every snapshot is gathered after the
+    // changes that made the last one stale and versions only grow.
+    std::mutex publish_mutex;
+    uint64_t version = 0;
+    std::atomic<std::shared_ptr<const MonitorSnapshot>> snapshot;
+    // The snapshot before the latest, reused for the next one once no
+    // reader holds it any more.
+    std::shared_ptr<MonitorSnapshot> spare;
+
+    // Only changes monitors can see count, so that the version stays put,
+    // and NOT_MODIFIED is answered, while nothing happens.
+    void markChanged() {
+        if (!stale.exchange(true, std::memory_order_acq_rel)) {
+            std::lock_guard<std::mutex> lock(change_mutex);
+            changed.notify_all();
+        }
+    }
+
+    void publishSnapshot() {
+        std::lock_guard<std::mutex> lock(publish_mutex);
+        // Whatever changes after this is gathered by the next publisher.
+        if (!stale.exchange(false, std::memory_order_acq_rel)) {
+            return;
+        }
+        std::shared_ptr<MonitorSnapshot> next;
+        if (spare && spare.use_count() == 1) {
+            // The last reader let go of it: nobody can get it again.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            next = std::move(spare);
+        } else {
+            next = std::make_shared<MonitorSnapshot>();
+        }
+        next->version = ++version;
+        next->gardener_count = connections.gardenerCount();
+        next->flowerbed_connected = connections.isFlowerbedConnected();
+        auto work = workQueue.pending(next->flowers_to_water);
+        next->flowers_to_water_total = work.waiting;
+        next->flowers_leased = work.leased;
+        next->leases_requeued = work.requeued;
+        updateLog.wateredFlowers(next->watered_flowers);
+        monitors.connected(next->monitors);
+        spare = std::const_pointer_cast<MonitorSnapshot>(snapshot.exchange(
+            std::move(next), std::memory_order_acq_rel));
+    }
 };
 
 #endif  // FLOWERBEDSTATEMANAGER_HPP
@@ -0,0 +1,386 @@
+#ifndef GARDENRPC_HPP
+#define GARDENRPC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rpc.hpp"
+
+// Schema of the flowerbed protocol. The text encoding of every method is
+// the one the clients spoke before the RPC layer existed.
+
+struct NoFields {
+    using Fields = RpcFields<>;
+};
+
+struct StatusOnly {
+    RpcStatus status = RpcStatus::Ok;
+    using Fields = RpcFields<>;
+};
+
+// "OK", or "ERR" when the gardener limit is reached.
+struct PingGardener {
+    static constexpr std::string_view route = "/ping/gardener/";
+    using Request = NoFields;
+    using Response = StatusOnly;
+};
+
+// "OK" for the first ping, "HC" once a flowerbed is already connected.
+struct PingFlowerbed {
+    static constexpr std::string_view route = "/ping/flowerbed/";
+    using Request = NoFields;
+    using Response = StatusOnly;
+};
+
+// State 1: watered, 0: dried out, 2: thirsty again (only with the server
+// side simulation).
+struct FlowerUpdate {
+    size_t flower;
+    int32_t state;
+    using Fields = RpcFields<&FlowerUpdate::flower, &FlowerUpdate::state>;
+};
+
+// Flowers [first, first + count) all in state, "first:count:state".
+struct FlowerRun {
+    size_t first;
+    size_t count;
+    int32_t state;
+    using Fields = RpcFields<&FlowerRun::first, &FlowerRun::count,
+                             &FlowerRun::state>;
+};
+
+// Reports after the client's cursor, the sequence number of the last report
+// it has seen. Text: "/getUpdates/<cursor>" is answered with
+// "@<cursor>;flower:state;...", or "@<cursor>;!;first:count:state;..." for
+// a resync, which carries the latest state of every flower as runs instead
+// of the reports. Without a cursor the server tracks one for the client and
+// answers in the original "flower:state;..." form.
+struct GetUpdates {
+    static constexpr std::string_view route = "/getUpdates/";
+    struct Request {
+        std::optional<uint64_t> cursor;
+        using Fields = RpcFields<&Request::cursor>;
+    };
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        std::optional<uint64_t> cursor;
+        bool resync = false;
+        std::vector<FlowerUpdate> updates;
+        std::vector<FlowerRun> runs;  // of a resync
+        using Fields = RpcFields<&Response::cursor, &Response::resync,
+                                 &Response::updates, &Response::runs>;
+
+        template <class Out>
+        static void writeText(Out &out, const Response &response) {
+            if (response.cursor) {
+                out.append(std::string_view("@"));
+                TextCodec::write(out, *response.cursor);
+                out.append(std::string_view(";"));
+                if (response.resync) {
+                    out.append(std::string_view("!;"));
+                    TextCodec::write(out, response.runs);
+                    return;
+                }
+            }
+            TextCodec::write(out, response.updates);
+        }
+
+        static bool readText(std::string_view in, Response &response) {
+            response.cursor.reset();
+            response.resync = false;
+            if (in.starts_with('@')) {
+                size_t end = in.find(';');
+                if (end == std::string_view::npos ||
+                    !TextCodec::read(in.substr(1, end - 1),
+                                     response.cursor.emplace())) {
+                    return false;
+                }
+                in.remove_prefix(end + 1);
+                if (in.starts_with("!;")) {
+                    response.resync = true;
+                    in.remove_prefix(2);
+                    response.updates.clear();
+                    return TextCodec::read(in, response.runs);
+                }
+            }
+            response.runs.clear();
+            return TextCodec::read(in, response.updates);
+        }
+    };
+};
+
+// Number of flowers in the garden, flowers are numbered from 0.
+struct FlowerCount {
+    static constexpr std::string_view route = "/flowerCount/";
+    using Request = NoFields;
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        uint64_t count = 0;
+        using Fields = RpcFields<&Response::count>;
+    };
+};
+
+// The next flower to water, -1 if there is none.
+struct GetFlower {
+    static constexpr std::string_view route = "/getFlower/";
+    using Request = NoFields;
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        int64_t flower = -1;
+        using Fields = RpcFields<&Response::flower>;
+    };
+};
+
+// Up to count flowers to water in one round trip: "/getFlower/?n=<count>"
+// is answered with "<flower>;...;", empty if there is nothing to do. With
+// "?n=<count>:<milliseconds>" a request that finds nothing waits up to that
+// long for flowers to be added before it is answered.
+struct GetFlowers {
+    static constexpr std::string_view route = "/getFlower/?n=";
+    struct Request {
+        uint32_t count = 1;
+        uint32_t wait_ms = 0;
+        using Fields = RpcFields<&Request::count, &Request::wait_ms>;
+
+        template <class Out>
+        static void writeText(Out &out, const Request &value) {
+            TextCodec::write(out, value.count);
+            if (value.wait_ms != 0) {
+                out.append(std::string_view(":"));
+                TextCodec::write(out, value.wait_ms);
+            }
+        }
+
+        static bool readText(std::string_view in, Request &value) {
+            size_t separator = in.find(':');
+            if (separator == std::string_view::npos) {
+                value.wait_ms = 0;
+                return TextCodec::read(in, value.count);
+            }
+            return TextCodec::read(in.substr(0, separator), value.count) &&
+                   TextCodec::read(in.substr(separator + 1), value.wait_ms);
+        }
+    };
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        std::vector<size_t> flowers;
+        using Fields = RpcFields<&Response::flowers>;
+    };
+};
+
+// "/water/<flower>" once a gardener has watered a flower, or
+// "/water/<flower>;...;" for several. "ERR" if a flower is out of range.
+struct WaterFlower {
+    static constexpr std::string_view route = "/water/";
+    struct Request {
+        std::vector<size_t> flowers;
+        using Fields = RpcFields<&Request::flowers>;
+    };
+    using Response = StatusOnly;
+};
+
+// A flower that needs water and, optionally, how soon it dries out. Text:
+// "<flower>" or "<flower>:<milliseconds>".
+struct FlowerToWater {
+    size_t flower = 0;
+    std::optional<uint32_t> dries_in_ms;
+    using Fields =
+        RpcFields<&FlowerToWater::flower, &FlowerToWater::dries_in_ms>;
+
+    template <class Out>
+    static void writeText(Out &out, const FlowerToWater &value) {
+        TextCodec::write(out, value.flower);
+        if (value.dries_in_ms) {
+            out.append(std::string_view(":"));
+            TextCodec::write(out, *value.dries_in_ms);
+        }
+    }
+
+    static bool readText(std::string_view in, FlowerToWater &value) {
+        size_t separator = in.find(':');
+        if (separator == std::string_view::npos) {
+            value.dries_in_ms.reset();
+            return TextCodec::read(in, value.flower);
+        }
+        return TextCodec::read(in.substr(0, separator), value.flower) &&
+               TextCodec::read(in.substr(separator + 1),
+                               value.dries_in_ms.emplace());
+    }
+};
+
+// "/toWater/<flower>;...;" from the flowerbed, "ERR" if any flower is out of
+// range. Gardeners get the flowers in the order they dry out.
+struct ToWater {
+    static constexpr std::string_view route = "/toWater/";
+    struct Request {
+        std::vector<FlowerToWater> flowers;
+        using Fields = RpcFields<&Request::flowers>;
+    };
+    using Response = StatusOnly;
+};
+
+// "/subscribe/<topic>" has the server push a topic as it changes instead
+// of being polled for it. The reply is the number of the first push frame,
+// see UDPClient::expectPushes. A push is "<topic>;" followed by the binary
+// response of the matching poll:
+//   "updates"           GetUpdates with a cursor; "updates:<cursor>"
+//                       continues after that cursor, plain "updates"
+//                       starts with the reports to come;
+//   "monitor"           Monitor; "monitor:<version>" skips the reports up
+//                       to the version the monitor has shown.
+// Subscribing again, say after a quiet spell, starts the stream over, but
+// only what the subscriber has not seen is pushed: nothing, if the garden
+// did not change.
+struct Subscribe {
+    static constexpr std::string_view route = "/subscribe/";
+    static constexpr std::string_view UPDATES = "updates";
+    static constexpr std::string_view MONITOR = "monitor";
+
+    struct Request {
+        std::string topic;
+        std::optional<uint64_t> cursor;
+        using Fields = RpcFields<&Request::topic, &Request::cursor>;
+
+        template <class Out>
+        static void writeText(Out &out, const Request &value) {
+            out.append(value.topic);
+            if (value.cursor) {
+                out.append(std::string_view(":"));
+                TextCodec::write(out, *value.cursor);
+            }
+        }
+
+        static bool readText(std::string_view in, Request &value) {
+            size_t separator = in.find(':');
+            value.topic.assign(in.substr(0, separator));
+            if (separator == std::string_view::npos) {
+                value.cursor.reset();
+                return true;
+            }
+            return TextCodec::read(in.substr(separator + 1),
+                                   value.cursor.emplace());
+        }
+    };
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        uint32_t first_push = 0;
+        using Fields = RpcFields<&Response::first_push>;
+    };
+
+    // Splits a push into its topic and the encoded response.
+    static bool splitPush(std::string_view push, std::string_view &topic,
+                          std::string_view &body) {
+        size_t separator = push.find(';');
+        if (separator == std::string_view::npos) {
+            return false;
+        }
+        topic = push.substr(0, separator);
+        body = push.substr(separator + 1);
+        return true;
+    }
+};
+
+// A connected monitor and when it connected, in seconds since the epoch.
+struct MonitorEntry {
+    std::string client_id;
+    int64_t connected_since = 0;
+    using Fields = RpcFields<&MonitorEntry::client_id,
+                             &MonitorEntry::connected_since>;
+};
+
+// State report for the monitors. Binary clients get the state and render it
+// themselves, see render; the text route answers with the rendered report,
+// as it always has. A request may carry the version of the report it has
+// seen, then it is answered NotModified until the state changes. In text,
+// "/monitor/<version>" is answered "NOT_MODIFIED" or
+// "@<version>;<report>".
+struct Monitor {
+    static constexpr std::string_view route = "/monitor/";
+    struct Request {
+        std::optional<uint64_t> version;
+        using Fields = RpcFields<&Request::version>;
+    };
+    struct Response {
+        RpcStatus status = RpcStatus::Ok;
+        uint64_t version = 0;  // of the server's state, grows with changes
+        uint32_t gardener_count = 0;
+        bool flowerbed_connected = false;
+        std::vector<size_t> flowers_to_water;  // the most urgent ones
+        uint64_t flowers_to_water_total = 0;
+        uint64_t flowers_leased = 0;
+        uint64_t leases_requeued = 0;
+        std::vector<size_t> watered_flowers;
+        std::vector<MonitorEntry> monitors;
+        using Fields =
+            RpcFields<&Response::version, &Response::gardener_count,
+                      &Response::flowerbed_connected,
+                      &Response::flowers_to_water,
+                      &Response::flowers_to_water_total,
+                      &Response::flowers_leased, &Response::leases_requeued,
+                      &Response::watered_flowers, &Response::monitors>;
+
+        template <class Out>
+        static void writeText(Out &out, const Response &response) {
+            out.append(std::string_view(render(response)));
+        }
+    };
+
+    static std::string render(const Response &report) {
+        std::string info = "";
+        info += "Gardeners connected: " +
+                std::to_string(report.gardener_count) + "\n";
+        info += "Flowerbed connected: " +
+                std::to_string(report.flowerbed_connected) + "\n";
+
+        info += "Flowers to water: ";
+        for (auto flower : report.flowers_to_water) {
+            info += std::to_string(flower) + " ";
+        }
+        if (report.flowers_to_water_total > report.flowers_to_water.size()) {
+            info += "... (" + std::to_string(report.flowers_to_water_total) +
+                    " total)";
+        }
+        info += "\n";
+
+        info += "Flowers being watered: " +
+                std::to_string(report.flowers_leased) +
+                " (requeued after lease expiry: " +
+                std::to_string(report.leases_requeued) + ")\n";
+
+        info += "Updates from gardeners (watered flowers):";
+        if (report.watered_flowers.empty()) {
+            info += "None";
+        } else {
+            info += "\n\t";
+            for (auto flower : report.watered_flowers) {
+                info += std::to_string(flower) + " ";
+            }
+        }
+
+        info += "\n";
+
+        info += "Connected monitors: ";
+        if (report.monitors.empty()) {
+            info += "None\n";
+        } else {
+            info += "\n\t";
+            for (const auto &[clientId, since] : report.monitors) {
+                std::time_t timet = since;
+                std::tm tm;
+                localtime_r(&timet, &tm);
+                char buffer[32] = {0};
+                std::strftime(buffer, 32, "%Y-%m-%d %H:%M:%S", &tm);
+                info += clientId + "\t connected since: " + buffer + "\n\t";
+            }
+        }
+
+        return info;
+    }
+};
+
+#endif  // GARDENRPC_HPP
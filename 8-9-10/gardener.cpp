@@ -6,21 +6,35 @@
 #include <mutex>
 #include <random>
 #include <thread>
+#include <utility>
 #include <vector>
 
+#include "garden_rpc.hpp"
+#include "session_file.hpp"
 #include "udp_client.hpp"
 
 class GardenerClient {
    public:
-    GardenerClient(const std::string &server_ip, uint16_t server_port)
-        : client(server_ip, server_port), stop_flag(false) {
+    GardenerClient(const std::string &server_ip, uint16_t server_port,
+                   SessionFile session_file)
+        : session(std::move(session_file)),
+          client(session.connect(server_ip, server_port)),
+          stop_flag(false) {
         std::srand(std::time(nullptr));
     }
 
+    // Used when the server gives no advice on when to call again.
     static constexpr uint32_t ping_interval = 5;
     static constexpr uint32_t min_watering_interval = 2;
     static constexpr uint32_t max_watering_interval = 5;
     static constexpr size_t retry_attempts = 3;
+    // Flowers fetched and reported per round trip.
+    static constexpr uint32_t watering_batch = 4;
+    // How long the server holds a request for flowers when there are none.
+    // Short enough that pings, which wait for the socket, stay in time.
+    static constexpr uint32_t wait_for_flowers_ms = 3000;
+    // Longest the server's advice is followed.
+    static constexpr auto max_poll_delay = std::chrono::seconds(30);
 
     void start() {
         jthreads.emplace_back(&GardenerClient::pingServer, this,
@@ -30,6 +44,7 @@ class GardenerClient {
     }
 
    private:
+    SessionFile session;
     UDPClient client;
     std::atomic<bool> stop_flag;
     std::mutex mtx;
@@ -40,22 +55,24 @@ class GardenerClient {
     void pingServer(std::stop_token stop_token) {
         try {
             while (!stop_token.stop_requested() && !stop_flag.load()) {
-                std::optional<std::string> response;
+                std::optional<PingGardener::Response> response;
+                std::chrono::milliseconds next_poll{0};
                 {
                     std::lock_guard<std::mutex> lock(socket_mtx);
                     std::cout << "[INFO] Pinging server..." << std::endl;
-                    response = client.sendMessage("/ping/gardener/",
-                                                  5);  // Timeout in seconds
+                    response = rpcCall<PingGardener>(
+                        client, {}, 5, &next_poll);  // Timeout in seconds
+                    session.save(client.getSessionTicket());
                 }
 
                 if (response.has_value()) {
-                    if (response.value() == "OK") {
-                        std::cout
-                            << "[INFO] Ping successful: " << response.value()
-                            << std::endl;
+                    if (response->status == RpcStatus::Ok) {
+                        std::cout << "[INFO] Ping successful: OK"
+                                  << std::endl;
                     } else {
                         std::cerr << "[ERROR] Unexpected ping response: "
-                                  << response.value() << std::endl;
+                                  << rpcStatusWord(response->status)
+                                  << std::endl;
                         stop_flag.store(true);
                         cv.notify_all();
                         break;
@@ -69,7 +86,8 @@ class GardenerClient {
                 }
 
                 std::this_thread::sleep_for(
-                    std::chrono::seconds(ping_interval));
+                    rpcPollDelay(next_poll, std::chrono::seconds(ping_interval),
+                                 max_poll_delay));
             }
         } catch (const std::exception &e) {
             std::cerr << "Ping thread exception: " << e.what() << std::endl;
@@ -85,36 +103,34 @@ class GardenerClient {
 
         try {
             while (!stop_token.stop_requested() && !stop_flag.load()) {
-                int sleep_duration = interval_dis(gen);
-                std::this_thread::sleep_for(
-                    std::chrono::seconds(sleep_duration));
-
-                int flower_index = -1;
+                std::vector<size_t> flowers;
+                std::chrono::milliseconds next_poll{0};
                 bool should_retry = true;
                 size_t attempts = 0;
 
                 while (should_retry && attempts < retry_attempts &&
                        !stop_token.stop_requested()) {
-                    std::optional<std::string> response;
+                    std::optional<GetFlowers::Response> response;
                     {
                         std::lock_guard<std::mutex> lock(socket_mtx);
-                        std::cout << "[INFO] Requesting flower from server..."
+                        std::cout << "[INFO] Requesting flowers from server..."
                                   << std::endl;
-                        response = client.sendMessage("/getFlower/", 10);
+                        response = rpcCall<GetFlowers>(
+                            client, {watering_batch, wait_for_flowers_ms}, 10,
+                            &next_poll);
                     }
 
                     if (response.has_value()) {
-                        const auto &val = response.value();
-                        if (val == "NOT_READY") {
-                            std::cerr
-                                << "[WARNING] Server not ready, retrying..."
-                                << std::endl;
+                        if (response->status == RpcStatus::Ok) {
+                            flowers = std::move(response->flowers);
+                            should_retry = false;
+                        } else {
+                            std::cerr << "[WARNING] Server answered "
+                                      << rpcStatusWord(response->status)
+                                      << ", retrying..." << std::endl;
                             attempts++;
                             std::this_thread::sleep_for(
                                 std::chrono::seconds(10));
-                        } else {
-                            flower_index = std::stoi(val);
-                            should_retry = false;
                         }
                     } else {
                         std::cerr << "[ERROR] No response received when "
@@ -134,37 +150,48 @@ class GardenerClient {
                     break;
                 }
 
-                if (flower_index < 0) {
+                // The server has already waited for work, so ask again
+                // right away unless it advises to back off.
+                if (flowers.empty()) {
                     std::cout << "[INFO] No flowers to water." << std::endl;
+                    std::this_thread::sleep_for(rpcPollDelay(
+                        next_poll, std::chrono::milliseconds::zero(),
+                        max_poll_delay));
                     continue;
                 } else {
-                    std::cout << "[INFO] Got flower number from server: "
-                              << flower_index << std::endl;
+                    std::cout << "[INFO] Got " << flowers.size()
+                              << " flowers from server" << std::endl;
                 }
 
+                int sleep_duration = interval_dis(gen);
+                std::this_thread::sleep_for(
+                    std::chrono::seconds(sleep_duration));
+
                 {
-                    std::optional<std::string> response;
+                    std::optional<WaterFlower::Response> response;
                     {
                         std::lock_guard<std::mutex> lock(socket_mtx);
-                        std::cout
-                            << "[INFO] Notifying server to water flower number "
-                            << flower_index << std::endl;
-                        response = client.sendMessage(
-                            "/water/" + std::to_string(flower_index), 10);
+                        std::cout << "[INFO] Notifying server that "
+                                  << flowers.size() << " flowers are watered"
+                                  << std::endl;
+                        response = rpcCall<WaterFlower>(client, {flowers}, 10);
                     }
 
                     if (response.has_value()) {
-                        if (response.value() != "OK") {
+                        if (response->status != RpcStatus::Ok) {
                             std::cerr << "[ERROR] Unexpected response to "
                                          "watering flower: "
-                                      << response.value() << std::endl;
+                                      << rpcStatusWord(response->status)
+                                      << std::endl;
                             stop_flag.store(true);
                             cv.notify_all();
                             break;
                         } else {
-                            std::cout << "[INFO] Flower " << flower_index
-                                      << " was watered successfully."
-                                      << std::endl;
+                            for (size_t flower : flowers) {
+                                std::cout << "[INFO] Flower " << flower
+                                          << " was watered successfully."
+                                          << std::endl;
+                            }
                         }
                     } else {
                         std::cerr << "[ERROR] No response received when "
@@ -197,22 +224,26 @@ class GardenerClient {
     }
 };
 
-void clientTask(const std::string &server_ip, uint16_t server_port) {
-    GardenerClient client(server_ip, server_port);
+void clientTask(const std::string &server_ip, uint16_t server_port,
+                const std::string &session_file) {
+    GardenerClient client(server_ip, server_port, SessionFile(session_file));
     client.start();
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <server_ip> <server_port>"
-                  << std::endl;
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <server_ip> <server_port> [session_file]" << std::endl;
         return EXIT_FAILURE;
     }
 
     std::string server_ip = argv[1];
     uint16_t server_port = std::stoi(argv[2]);
+    // A restarted client resumes the session saved there.
+    std::string session_file = argc == 4 ? argv[3] : "";
 
-    std::thread client_thread(clientTask, server_ip, server_port);
+    std::thread client_thread(clientTask, server_ip, server_port,
+                              session_file);
     client_thread.join();
 
     return 0;
@@ -1,26 +1,54 @@
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <utility>
 
+#include "garden_rpc.hpp"
+#include "session_file.hpp"
 #include "udp_client.hpp"
 
 class MonitorClient {
    public:
-    MonitorClient(const std::string &server_ip, uint16_t server_port)
-        : client(server_ip, server_port) {}
+    MonitorClient(const std::string &server_ip, uint16_t server_port,
+                  SessionFile session_file)
+        : session(std::move(session_file)),
+          client(session.connect(server_ip, server_port)) {}
+
+    // Without a push for this long the subscription is renewed, in case
+    // the server gave up on us.
+    static constexpr auto resubscribeInterval = std::chrono::seconds(5);
+    // Polling, while the server takes no subscription, when it gives no
+    // advice on when to poll again.
+    static constexpr auto pollInterval = std::chrono::seconds(1);
+    static constexpr auto maxPollDelay = std::chrono::seconds(10);
 
     void start() {
+        auto last_push = std::chrono::steady_clock::time_point{};
         while (true) {
             try {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                auto response = client.sendMessage("/monitor/");
-                if (response.has_value()) {
-                    std::cout << "----------------------------\n";
-                    std::cout << response.value() << std::endl;
-                } else {
-                    std::cerr << "[ERROR] No response received to monitor."
-                              << std::endl;
+                if (std::chrono::steady_clock::now() - last_push >
+                    resubscribeInterval) {
+                    if (!subscribe()) {
+                        std::this_thread::sleep_for(poll());
+                        continue;
+                    }
+                    last_push = std::chrono::steady_clock::now();
+                }
+
+                auto push = client.receivePush(1);
+                std::string_view topic, body;
+                Monitor::Response response;
+                if (!push || !Subscribe::splitPush(*push, topic, body) ||
+                    topic != Subscribe::MONITOR ||
+                    !BinaryCodec::readResponse(body, response)) {
+                    continue;
                 }
+                last_push = std::chrono::steady_clock::now();
+                show(response);
             } catch (const std::exception &e) {
                 std::cerr
                     << "[ERROR] Error occired while geting info from server: "
@@ -30,25 +58,79 @@ class MonitorClient {
     }
 
    private:
+    SessionFile session;
     UDPClient client;
+    // Of the last report shown, polls and subscriptions ask for a newer
+    // one.
+    std::optional<uint64_t> version;
+
+    void show(const Monitor::Response &response) {
+        version = response.version;
+        std::cout << "----------------------------\n";
+        // The server sends the state, the report is rendered here.
+        std::cout << Monitor::render(response) << std::endl;
+    }
+
+    // Asks for the report only if it changed since the last one shown.
+    // Returns how long to wait before the next poll.
+    std::chrono::milliseconds poll() {
+        std::chrono::milliseconds next_poll{0};
+        auto response = rpcCall<Monitor>(client, {version}, 5, &next_poll);
+        session.save(client.getSessionTicket());
+        if (!response.has_value()) {
+            std::cerr << "[ERROR] No response received to monitor."
+                      << std::endl;
+        } else if (response->status == RpcStatus::Ok) {
+            show(*response);
+        } else if (response->status != RpcStatus::NotModified) {
+            std::cerr << "[ERROR] Server answered "
+                      << rpcStatusWord(response->status) << " to monitor."
+                      << std::endl;
+        }
+        return rpcPollDelay(next_poll, pollInterval, maxPollDelay);
+    }
+
+    // The server pushes every new report instead of being polled for it.
+    bool subscribe() {
+        auto response = rpcCall<Subscribe>(
+            client, {std::string(Subscribe::MONITOR), version}, 5);
+        session.save(client.getSessionTicket());
+        if (!response.has_value()) {
+            std::cerr << "[ERROR] No response received to monitor."
+                      << std::endl;
+            return false;
+        }
+        if (response->status != RpcStatus::Ok) {
+            std::cerr << "[ERROR] Server answered "
+                      << rpcStatusWord(response->status)
+                      << " to the subscription." << std::endl;
+            return false;
+        }
+        client.expectPushes(response->first_push);
+        return true;
+    }
 };
 
-void clientTask(const std::string &server_ip, uint16_t server_port) {
-    MonitorClient client(server_ip, server_port);
+void clientTask(const std::string &server_ip, uint16_t server_port,
+                const std::string &session_file) {
+    MonitorClient client(server_ip, server_port, SessionFile(session_file));
     client.start();
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <server_ip> <server_port>"
-                  << std::endl;
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <server_ip> <server_port> [session_file]" << std::endl;
         return EXIT_FAILURE;
     }
 
     std::string server_ip = argv[1];
     uint16_t server_port = std::stoi(argv[2]);
+    // A restarted client resumes the session saved there.
+    std::string session_file = argc == 4 ? argv[3] : "";
 
-    std::thread client_thread(clientTask, server_ip, server_port);
+    std::thread client_thread(clientTask, server_ip, server_port,
+                              session_file);
     client_thread.join();
 
     return 0;
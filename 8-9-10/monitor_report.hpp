@@ -0,0 +1,60 @@
+#ifndef MONITORREPORT_HPP
+#define MONITORREPORT_HPP
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "flowerbed_state_manager.hpp"
+#include "garden_rpc.hpp"
+
+// The monitor report of one snapshot, each form built at most once however
+// many monitors get it: the binary push shared by every subscriber, and the
+// rendered text for the monitors that still poll the text route.
+class MonitorReport {
+   public:
+    explicit MonitorReport(const MonitorSnapshot &snapshot) {
+        response.version = snapshot.version;
+        response.gardener_count =
+            static_cast<uint32_t>(snapshot.gardener_count);
+        response.flowerbed_connected = snapshot.flowerbed_connected;
+        response.flowers_to_water = snapshot.flowers_to_water;
+        response.flowers_to_water_total = snapshot.flowers_to_water_total;
+        response.flowers_leased = snapshot.flowers_leased;
+        response.leases_requeued = snapshot.leases_requeued;
+        response.watered_flowers = snapshot.watered_flowers;
+        for (const auto &[clientId, since] : snapshot.monitors) {
+            response.monitors.push_back(
+                {clientId, std::chrono::duration_cast<std::chrono::seconds>(
+                               since.time_since_epoch())
+                               .count()});
+        }
+    }
+
+    uint64_t version() const { return response.version; }
+    const Monitor::Response &state() const { return response; }
+
+    // "monitor;" and the binary response, see Subscribe.
+    const std::string &push() const {
+        std::call_once(pushed, [this] {
+            push_.append(Subscribe::MONITOR).append(";");
+            BinaryCodec::writeResponse(push_, response);
+        });
+        return push_;
+    }
+
+    const std::string &text() const {
+        std::call_once(rendered, [this] { text_ = Monitor::render(response); });
+        return text_;
+    }
+
+   private:
+    Monitor::Response response;
+    mutable std::once_flag pushed;
+    mutable std::string push_;
+    mutable std::once_flag rendered;
+    mutable std::string text_;
+};
+
+#endif  // MONITORREPORT_HPP
@@ -3,37 +3,209 @@
 
 #include <netinet/in.h>
 
+#include <charconv>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <ostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+// Caller-provided buffer a route handler writes its response into. The
+// caller reuses it between requests, so once its capacity has grown to the
+// usual response size, answering does not touch the heap.
+class ResponseBuffer {
+   public:
+    void clear() {
+        data_.clear();
+        deferred_ = false;
+        inline_only_ = false;
+    }
+    bool empty() const { return data_.empty(); }
+    std::string_view view() const { return data_; }
+
+    // Marks a request the handler will answer later, on its own: nothing is
+    // sent for it now.
+    void defer() { deferred_ = true; }
+    bool deferred() const { return deferred_; }
+    // Marks a response that has to be complete when the handler returns,
+    // a part of a batch: a call that would be deferred is refused instead.
+    void requireInline() { inline_only_ = true; }
+    bool canDefer() const { return !inline_only_; }
+
+    ResponseBuffer &append(std::string_view text) {
+        data_.append(text);
+        return *this;
+    }
+
+    template <class Integer>
+    ResponseBuffer &appendNumber(Integer value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        data_.append(digits, result.ptr);
+        return *this;
+    }
+
+   private:
+    std::string data_;
+    bool deferred_ = false;
+    bool inline_only_ = false;
+};
+
+// Netstrings, "<length>:<bytes>,", frame the calls of a batch and their
+// responses, so parts can hold any bytes, binary payloads included.
+template <class Out>
+void appendNetstring(Out &out, std::string_view value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value.size());
+    out.append(std::string_view(digits, result.ptr - digits));
+    out.append(std::string_view(":"));
+    out.append(value);
+    out.append(std::string_view(","));
+}
+
+// Consumes one netstring from the front of in.
+inline bool readNetstring(std::string_view &in, std::string_view &value) {
+    size_t length = 0;
+    auto result = std::from_chars(in.data(), in.data() + in.size(), length);
+    size_t digits = result.ptr - in.data();
+    if (result.ec != std::errc() || digits == in.size() ||
+        in[digits] != ':' || in.size() - digits - 1 <= length ||
+        in[digits + 1 + length] != ',') {
+        return false;
+    }
+    value = in.substr(digits + 1, length);
+    in.remove_prefix(digits + length + 2);
+    return true;
+}
+
+// Routes are compiled into a byte trie, so a message is matched in one pass
+// over its path and the longest registered prefix wins. Handlers get views
+// into the message, nothing is copied.
 class RouteManager {
    public:
     using RouteHandler = std::function<void(
         const std::string &client_id, struct sockaddr_in &addr,
-        const std::string &prefix, const std::string &suffix)>;
+        std::string_view prefix, std::string_view suffix,
+        ResponseBuffer &response)>;
+    // Whether a call of a batch may run, see registerBatchRoute.
+    using CallFilter = std::function<bool(const std::string &client_id,
+                                          std::string_view call)>;
 
     void registerRoute(const std::string &prefix, RouteHandler handler) {
-        routes_[prefix] = std::move(handler);
+        uint32_t node = 0;
+        for (char c : prefix) {
+            node = findOrAddChild(node, c);
+        }
+        if (nodes_[node].handler < 0) {
+            nodes_[node].handler = static_cast<int>(handlers_.size());
+            handlers_.push_back(std::move(handler));
+        } else {
+            handlers_[nodes_[node].handler] = std::move(handler);
+        }
     }
 
-    void handleRoute(const std::string &client_id, struct sockaddr_in &addr,
-                     const std::string &message) {
-        for (const auto &route : routes_) {
-            if (message.find(route.first) == 0) {
-                std::string prefix = route.first;
-                std::string suffix = message.substr(prefix.length());
-                route.second(client_id, addr, prefix, suffix);
-                return;
+    // Returns false if no route matched, the response is left untouched.
+    bool handleRoute(const std::string &client_id, struct sockaddr_in &addr,
+                     std::string_view message, ResponseBuffer &response) {
+        int handler = nodes_[0].handler;
+        size_t prefix_length = 0;
+        uint32_t node = 0;
+        for (size_t i = 0; i < message.size(); ++i) {
+            node = findChild(node, message[i]);
+            if (node == 0) {
+                break;
             }
+            if (nodes_[node].handler >= 0) {
+                handler = nodes_[node].handler;
+                prefix_length = i + 1;
+            }
+        }
+
+        if (handler < 0) {
+            std::cerr << "No route found for message: " << message
+                      << std::endl;
+            return false;
         }
-        std::cerr << "No route found for message: " << message << std::endl;
+        handlers_[handler](client_id, addr, message.substr(0, prefix_length),
+                           message.substr(prefix_length), response);
+        return true;
+    }
+
+    // Most calls one batch may carry.
+    static constexpr size_t MAX_BATCH_CALLS = 16;
+
+    // Registers prefix as an envelope for several calls in one message: its
+    // payload is a run of netstrings, each a message for another route, and
+    // the response the netstrings of their responses, in the same order.
+    // The calls run one after another, as if they had come separately, each
+    // only if admit lets it (the server charges it to its route's rate
+    // limit there). A part is empty if its call was not admitted or has no
+    // route. A call that would be answered later on its own (see
+    // ResponseBuffer::defer) is refused, such calls have to be sent alone.
+    // A malformed envelope, or one that nests batches, runs nothing and is
+    // answered "ERR".
+    void registerBatchRoute(const std::string &prefix, CallFilter admit) {
+        registerRoute(prefix, [this, prefix, admit = std::move(admit)](
+                                  const std::string &client_id,
+                                  struct sockaddr_in &addr, std::string_view,
+                                  std::string_view payload,
+                                  ResponseBuffer &response) {
+            std::string_view calls[MAX_BATCH_CALLS];
+            size_t count = 0;
+            while (!payload.empty()) {
+                if (count == MAX_BATCH_CALLS ||
+                    !readNetstring(payload, calls[count]) ||
+                    calls[count].starts_with(prefix)) {
+                    response.append("ERR");
+                    return;
+                }
+                ++count;
+            }
+            thread_local ResponseBuffer part;
+            for (size_t i = 0; i < count; ++i) {
+                part.clear();
+                part.requireInline();
+                if (!admit(client_id, calls[i]) ||
+                    !handleRoute(client_id, addr, calls[i], part)) {
+                    part.clear();
+                }
+                appendNetstring(response, part.view());
+            }
+        });
     }
 
    private:
-    std::unordered_map<std::string, RouteHandler> routes_;
+    struct Node {
+        std::vector<std::pair<char, uint32_t>> children;
+        int handler = -1;
+    };
+
+    std::vector<Node> nodes_{1};
+    std::vector<RouteHandler> handlers_;
+
+    // Returns 0 (the root, which is never a child) when there is no edge.
+    uint32_t findChild(uint32_t node, char c) const {
+        for (const auto &[label, child] : nodes_[node].children) {
+            if (label == c) {
+                return child;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t findOrAddChild(uint32_t node, char c) {
+        uint32_t child = findChild(node, c);
+        if (child != 0) {
+            return child;
+        }
+        child = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[node].children.emplace_back(c, child);
+        return child;
+    }
 };
 
 #endif  // ROUTEMANAGER_HPP
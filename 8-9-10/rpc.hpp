@@ -0,0 +1,715 @@
+#ifndef RPC_HPP
+#define RPC_HPP
+
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "message_dispatcher.hpp"
+#include "route_manager.hpp"
+
+// Typed RPC on top of RouteManager. A method is declared once as a schema:
+//
+//     struct GetFlower {
+//         static constexpr std::string_view route = "/getFlower/";
+//         struct Request {
+//             using Fields = RpcFields<>;
+//         };
+//         struct Response {
+//             RpcStatus status = RpcStatus::Ok;
+//             int64_t flower = -1;
+//             using Fields = RpcFields<&Response::flower>;
+//         };
+//     };
+//
+// and both wire formats are generated from the field lists. Every method is
+// served under its route in the legacy text format and under "/bin" + route
+// in a compact binary one. Decoding never throws: a malformed payload is
+// answered with RpcStatus::Error.
+//
+// A binary response may end with the server's advice on when to call the
+// method again, see RpcPacer and rpcCall.
+
+// NotModified answers a conditional request whose copy is still current.
+enum class RpcStatus : uint8_t {
+    Ok,
+    NotReady,
+    Error,
+    AlreadyConnected,
+    NotModified
+};
+
+// Highest value of an enum sent on the wire, every enum a schema uses needs
+// one. Decoding anything outside of 0..value fails like other malformed
+// input.
+template <class T>
+struct RpcEnumMax;
+
+template <>
+struct RpcEnumMax<RpcStatus> {
+    static constexpr RpcStatus value = RpcStatus::NotModified;
+};
+
+template <class T>
+constexpr bool rpcEnumInRange(std::underlying_type_t<T> raw) {
+    return std::cmp_greater_equal(raw, 0) &&
+           raw <= static_cast<std::underlying_type_t<T>>(RpcEnumMax<T>::value);
+}
+
+inline constexpr std::string_view RPC_BINARY_PREFIX = "/bin";
+// Route of the envelope that carries several calls, see RpcBatch.
+inline constexpr std::string_view RPC_BATCH_ROUTE = "/batch/";
+
+// Words the text format has always used in place of a response body.
+inline std::string_view rpcStatusWord(RpcStatus status) {
+    switch (status) {
+        case RpcStatus::Ok:
+            return "OK";
+        case RpcStatus::NotReady:
+            return "NOT_READY";
+        case RpcStatus::AlreadyConnected:
+            return "HC";
+        case RpcStatus::NotModified:
+            return "NOT_MODIFIED";
+        default:
+            return "ERR";
+    }
+}
+
+template <auto... Members>
+struct RpcFields {
+    static constexpr size_t count = sizeof...(Members);
+
+    // Calls f on every field in declaration order, stops at the first false.
+    template <class T, class F>
+    static bool all(T &object, F &&f) {
+        return (f(object.*Members) && ...);
+    }
+};
+
+template <class T>
+struct IsRpcList : std::false_type {};
+template <class T, class Allocator>
+struct IsRpcList<std::vector<T, Allocator>> : std::true_type {};
+
+template <class T>
+struct IsRpcOptional : std::false_type {};
+template <class T>
+struct IsRpcOptional<std::optional<T>> : std::true_type {};
+
+// Binary format: unsigned integers and enums are LEB128 varints, signed
+// integers are zigzag encoded first, strings and lists are prefixed with
+// their length and structs are their fields back to back.
+class BinaryCodec {
+   public:
+    template <class Out, class T>
+    static void write(Out &out, const T &value) {
+        if constexpr (std::is_enum_v<T>) {
+            writeVarint(out, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_unsigned_v<T>) {
+            writeVarint(out, value);
+        } else if constexpr (std::is_integral_v<T>) {
+            auto signed_value = static_cast<int64_t>(value);
+            writeVarint(out, (static_cast<uint64_t>(signed_value) << 1) ^
+                                 static_cast<uint64_t>(signed_value >> 63));
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            writeVarint(out, value.size());
+            out.append(std::string_view(value));
+        } else if constexpr (IsRpcList<T>::value) {
+            writeVarint(out, value.size());
+            for (const auto &element : value) {
+                write(out, element);
+            }
+        } else if constexpr (IsRpcOptional<T>::value) {
+            writeVarint(out, value.has_value());
+            if (value) {
+                write(out, *value);
+            }
+        } else {
+            T::Fields::all(value, [&](const auto &field) {
+                write(out, field);
+                return true;
+            });
+        }
+    }
+
+    // Consumes the value from the front of in.
+    template <class T>
+    static bool read(std::string_view &in, T &value) {
+        if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw;
+            if (!read(in, raw) || !rpcEnumInRange<T>(raw)) {
+                return false;
+            }
+            value = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_unsigned_v<T>) {
+            uint64_t raw;
+            if (!readVarint(in, raw) ||
+                raw > std::numeric_limits<T>::max()) {
+                return false;
+            }
+            value = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_integral_v<T>) {
+            uint64_t raw;
+            if (!readVarint(in, raw)) {
+                return false;
+            }
+            auto decoded = static_cast<int64_t>(raw >> 1) ^
+                           -static_cast<int64_t>(raw & 1);
+            if (decoded < std::numeric_limits<T>::min() ||
+                decoded > std::numeric_limits<T>::max()) {
+                return false;
+            }
+            value = static_cast<T>(decoded);
+            return true;
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            uint64_t length;
+            if (!readVarint(in, length) || length > in.size()) {
+                return false;
+            }
+            value.assign(in.substr(0, length));
+            in.remove_prefix(length);
+            return true;
+        } else if constexpr (IsRpcList<T>::value) {
+            // Every element takes at least one byte, which bounds the size
+            // a hostile length prefix can make us allocate.
+            uint64_t count;
+            if (!readVarint(in, count) || count > in.size()) {
+                return false;
+            }
+            value.resize(count);
+            for (auto &element : value) {
+                if (!read(in, element)) {
+                    return false;
+                }
+            }
+            return true;
+        } else if constexpr (IsRpcOptional<T>::value) {
+            bool present;
+            if (!read(in, present)) {
+                return false;
+            }
+            if (!present) {
+                value.reset();
+                return true;
+            }
+            return read(in, value.emplace());
+        } else {
+            return T::Fields::all(
+                value, [&](auto &field) { return read(in, field); });
+        }
+    }
+
+    // next_poll_ms, unless 0, follows the response as a varint.
+    template <class Out, class Response>
+    static void writeResponse(Out &out, const Response &response,
+                              uint32_t next_poll_ms = 0) {
+        write(out, response.status);
+        if (response.status == RpcStatus::Ok) {
+            write(out, response);
+        }
+        if (next_poll_ms != 0) {
+            write(out, next_poll_ms);
+        }
+    }
+
+    // A response without the trailing advice reads as next_poll_ms 0.
+    template <class Response>
+    static bool readResponse(std::string_view in, Response &response,
+                             uint32_t *next_poll_ms = nullptr) {
+        if (!read(in, response.status)) {
+            return false;
+        }
+        if (response.status == RpcStatus::Ok && !read(in, response)) {
+            return false;
+        }
+        uint32_t advice = 0;
+        if (!in.empty() && !read(in, advice)) {
+            return false;
+        }
+        if (next_poll_ms) {
+            *next_poll_ms = advice;
+        }
+        return in.empty();
+    }
+
+   private:
+    template <class Out>
+    static void writeVarint(Out &out, uint64_t value) {
+        char bytes[10];
+        size_t length = 0;
+        do {
+            auto byte = static_cast<uint8_t>(value & 0x7f);
+            value >>= 7;
+            bytes[length++] = static_cast<char>(value ? byte | 0x80 : byte);
+        } while (value != 0);
+        out.append(std::string_view(bytes, length));
+    }
+
+    static bool readVarint(std::string_view &in, uint64_t &value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+            auto byte = static_cast<uint8_t>(in.front());
+            in.remove_prefix(1);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Text format the clients have always spoken: decimal numbers, struct fields
+// joined with ':', list elements each followed by ';', a string takes the
+// rest of its field, an absent optional is empty. A response that is not
+// Ok, or has no fields, is just its status word. A struct whose legacy
+// format does not fit these rules provides static writeText and readText.
+class TextCodec {
+   public:
+    template <class Out, class T>
+    static void write(Out &out, const T &value) {
+        if constexpr (std::is_enum_v<T>) {
+            write(out, static_cast<std::underlying_type_t<T>>(value));
+        } else if constexpr (std::is_same_v<T, bool>) {
+            out.append(std::string_view(value ? "1" : "0"));
+        } else if constexpr (std::is_integral_v<T>) {
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(std::string_view(digits, result.ptr - digits));
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            out.append(std::string_view(value));
+        } else if constexpr (IsRpcList<T>::value) {
+            for (const auto &element : value) {
+                write(out, element);
+                out.append(std::string_view(";"));
+            }
+        } else if constexpr (IsRpcOptional<T>::value) {
+            if (value) {
+                write(out, *value);
+            }
+        } else if constexpr (requires { T::writeText(out, value); }) {
+            T::writeText(out, value);
+        } else {
+            bool first = true;
+            T::Fields::all(value, [&](const auto &field) {
+                if (!first) {
+                    out.append(std::string_view(":"));
+                }
+                first = false;
+                write(out, field);
+                return true;
+            });
+        }
+    }
+
+    // Parses exactly in, nothing may be left over.
+    template <class T>
+    static bool read(std::string_view in, T &value) {
+        if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw;
+            if (!read(in, raw) || !rpcEnumInRange<T>(raw)) {
+                return false;
+            }
+            value = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            if (in != "0" && in != "1") {
+                return false;
+            }
+            value = in == "1";
+            return true;
+        } else if constexpr (std::is_integral_v<T>) {
+            const char *end = in.data() + in.size();
+            auto result = std::from_chars(in.data(), end, value);
+            return !in.empty() && result.ec == std::errc() &&
+                   result.ptr == end;
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            value.assign(in);
+            return true;
+        } else if constexpr (IsRpcList<T>::value) {
+            value.clear();
+            while (!in.empty()) {
+                size_t end = std::min(in.find(';'), in.size());
+                if (!read(in.substr(0, end), value.emplace_back())) {
+                    return false;
+                }
+                in.remove_prefix(std::min(end + 1, in.size()));
+            }
+            return true;
+        } else if constexpr (IsRpcOptional<T>::value) {
+            if (in.empty()) {
+                value.reset();
+                return true;
+            }
+            return read(in, value.emplace());
+        } else if constexpr (requires { T::readText(in, value); }) {
+            return T::readText(in, value);
+        } else {
+            if constexpr (T::Fields::count == 0) {
+                return in.empty();
+            } else {
+                size_t index = 0;
+                return T::Fields::all(value, [&](auto &field) {
+                    std::string_view part = in;
+                    if (++index < T::Fields::count) {
+                        size_t separator = in.find(':');
+                        if (separator == std::string_view::npos) {
+                            return false;
+                        }
+                        part = in.substr(0, separator);
+                        in.remove_prefix(separator + 1);
+                    }
+                    return read(part, field);
+                });
+            }
+        }
+    }
+
+    template <class Out, class Response>
+    static void writeResponse(Out &out, const Response &response) {
+        if (response.status != RpcStatus::Ok || Response::Fields::count == 0) {
+            out.append(rpcStatusWord(response.status));
+            return;
+        }
+        write(out, response);
+    }
+
+    template <class Response>
+    static bool readResponse(std::string_view in, Response &response) {
+        for (auto status :
+             {RpcStatus::Ok, RpcStatus::NotReady, RpcStatus::Error,
+              RpcStatus::AlreadyConnected, RpcStatus::NotModified}) {
+            if (in == rpcStatusWord(status) &&
+                (status != RpcStatus::Ok || Response::Fields::count == 0)) {
+                response.status = status;
+                return true;
+            }
+        }
+        response.status = RpcStatus::Ok;
+        return read(in, response);
+    }
+};
+
+// Clears a message for reuse: numbers are zeroed, strings and lists are
+// emptied but keep their capacity.
+template <class T>
+void rpcReset(T &value) {
+    if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+        value = T{};
+    } else if constexpr (std::is_same_v<T, std::string> ||
+                         IsRpcList<T>::value) {
+        value.clear();
+    } else if constexpr (IsRpcOptional<T>::value) {
+        value.reset();
+    } else {
+        T::Fields::all(value, [](auto &field) {
+            rpcReset(field);
+            return true;
+        });
+    }
+}
+
+// Server side: how long the client had better wait before calling the
+// method again, worked out from the response it is about to get. Zero is no
+// advice. Only binary clients are told, the text format has no room for it.
+template <class Method>
+using RpcPacer = std::function<std::chrono::milliseconds(
+    const std::string &client_id, const typename Method::Response &response)>;
+
+template <class Method>
+uint32_t rpcAdvice(const RpcPacer<Method> &pacer, const std::string &client_id,
+                   const typename Method::Response &response) {
+    if (!pacer) {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::clamp<int64_t>(
+        pacer(client_id, response).count(), 0,
+        std::numeric_limits<uint32_t>::max()));
+}
+
+// The answer to a call its handler finishes later, possibly on another
+// thread. It is encoded the way the request came in and sent through the
+// dispatcher, which is safe from any thread.
+template <class Method>
+class RpcReply {
+   public:
+    RpcReply(MessageDispatcher &dispatcher, const std::string &client_id,
+             const struct sockaddr_in &addr, bool binary,
+             RpcPacer<Method> pacer = {})
+        : dispatcher(&dispatcher),
+          client_id(client_id),
+          addr(addr),
+          binary(binary),
+          pacer(std::move(pacer)) {}
+
+    void send(const typename Method::Response &response) {
+        ResponseBuffer out;
+        if (binary) {
+            BinaryCodec::writeResponse(
+                out, response, rpcAdvice<Method>(pacer, client_id, response));
+        } else {
+            TextCodec::writeResponse(out, response);
+        }
+        dispatcher->sendMessage(client_id, addr, out.view());
+    }
+
+   private:
+    MessageDispatcher *dispatcher;
+    std::string client_id;
+    struct sockaddr_in addr;
+    bool binary;
+    RpcPacer<Method> pacer;
+};
+
+// Server side: registers typed handlers as routes of a RouteManager.
+class RpcRouter {
+   public:
+    RpcRouter(RouteManager &routeManager, MessageDispatcher &dispatcher)
+        : routeManager(routeManager), dispatcher(dispatcher) {}
+
+    // handler(client_id, request, response); response starts out Ok. A
+    // handler that needs the caller's address, to push to it later, takes
+    // (client_id, addr, request, response) instead. The pacer, if any,
+    // advises binary callers when to call again.
+    template <class Method, class Handler>
+    void on(Handler handler, RpcPacer<Method> pacer = {}) {
+        registerMethod<Method>(
+            std::move(pacer),
+            [handler](const std::string &client_id, struct sockaddr_in &addr,
+                      bool, const typename Method::Request &request,
+                      typename Method::Response &response, ResponseBuffer &) {
+                if constexpr (std::is_invocable_v<
+                                  const Handler &, const std::string &,
+                                  const struct sockaddr_in &,
+                                  const typename Method::Request &,
+                                  typename Method::Response &>) {
+                    handler(client_id, addr, request, response);
+                } else {
+                    handler(client_id, request, response);
+                }
+            });
+    }
+
+    // handler(client_id, request, response, defer) for calls that may have
+    // to wait: instead of filling the response the handler can call defer(),
+    // keep the RpcReply<Method> it returns and send the answer later. Where
+    // the answer cannot come later, in a batch, the call is answered Error
+    // without running the handler.
+    template <class Method, class Handler>
+    void onDeferrable(Handler handler, RpcPacer<Method> pacer = {}) {
+        registerMethod<Method>(
+            pacer, [handler, pacer, this](
+                       const std::string &client_id, struct sockaddr_in &addr,
+                       bool binary, const typename Method::Request &request,
+                       typename Method::Response &response,
+                       ResponseBuffer &out) {
+                if (!out.canDefer()) {
+                    response.status = RpcStatus::Error;
+                    return;
+                }
+                handler(client_id, request, response, [&] {
+                    out.defer();
+                    return RpcReply<Method>(dispatcher, client_id, addr,
+                                            binary, pacer);
+                });
+            });
+    }
+
+   private:
+    RouteManager &routeManager;
+    MessageDispatcher &dispatcher;
+
+    template <class Method, class Call>
+    void registerMethod(RpcPacer<Method> pacer, Call call) {
+        routeManager.registerRoute(
+            std::string(Method::route),
+            [call](const std::string &client_id, struct sockaddr_in &addr,
+                   std::string_view, std::string_view payload,
+                   ResponseBuffer &response) {
+                serve<Method>(call, {}, client_id, addr, payload, false,
+                              response);
+            });
+        routeManager.registerRoute(
+            std::string(RPC_BINARY_PREFIX) + std::string(Method::route),
+            [call, pacer = std::move(pacer)](
+                const std::string &client_id, struct sockaddr_in &addr,
+                std::string_view, std::string_view payload,
+                ResponseBuffer &response) {
+                serve<Method>(call, pacer, client_id, addr, payload, true,
+                              response);
+            });
+    }
+
+    template <class Method, class Call>
+    static void serve(const Call &call, const RpcPacer<Method> &pacer,
+                      const std::string &client_id, struct sockaddr_in &addr,
+                      std::string_view payload, bool binary,
+                      ResponseBuffer &out) {
+        // Decoded messages are reused per thread, so once their lists have
+        // grown to the usual size a call does not touch the heap.
+        thread_local typename Method::Request request;
+        thread_local typename Method::Response response;
+        rpcReset(request);
+        rpcReset(response);
+        response.status = RpcStatus::Ok;
+
+        bool valid = binary ? BinaryCodec::read(payload, request) &&
+                                  payload.empty()
+                            : TextCodec::read(payload, request);
+        if (valid) {
+            call(client_id, addr, binary, request, response, out);
+            if (out.deferred()) {
+                return;
+            }
+        } else {
+            response.status = RpcStatus::Error;
+        }
+
+        if (binary) {
+            BinaryCodec::writeResponse(
+                out, response, rpcAdvice<Method>(pacer, client_id, response));
+        } else {
+            TextCodec::writeResponse(out, response);
+        }
+    }
+};
+
+// Client side: calls a method over the binary route. Returns nullopt if the
+// server did not answer, a reply that does not decode reads as Error. If
+// next_poll is given it gets the server's advice on when to call again,
+// zero if there was none.
+template <class Method, class Client>
+std::optional<typename Method::Response> rpcCall(
+    Client &client, const typename Method::Request &request, int timeout,
+    std::chrono::milliseconds *next_poll = nullptr) {
+    if (next_poll) {
+        *next_poll = std::chrono::milliseconds::zero();
+    }
+    std::string message(RPC_BINARY_PREFIX);
+    message += Method::route;
+    BinaryCodec::write(message, request);
+
+    auto reply = client.sendMessage(message, timeout);
+    if (!reply) {
+        return std::nullopt;
+    }
+    typename Method::Response response;
+    uint32_t next_poll_ms = 0;
+    if (!BinaryCodec::readResponse(*reply, response, &next_poll_ms)) {
+        rpcReset(response);
+        response.status = RpcStatus::Error;
+        next_poll_ms = 0;
+    }
+    if (next_poll) {
+        *next_poll = std::chrono::milliseconds(next_poll_ms);
+    }
+    return response;
+}
+
+// Client side: several calls sent in one message and answered in one,
+// instead of a round trip each. The server must have registered
+// RPC_BATCH_ROUTE with RouteManager::registerBatchRoute. Methods the server
+// may defer are answered Error in a batch, they have to be called alone.
+//
+//     RpcBatch batch;
+//     batch.add<PingFlowerbed>({});
+//     batch.add<ToWater>(request);
+//     if (batch.send(client, 10)) {
+//         auto ping = batch.reply<PingFlowerbed>(0);
+//         auto added = batch.reply<ToWater>(1);
+//     }
+class RpcBatch {
+   public:
+    RpcBatch() : message(RPC_BATCH_ROUTE) {}
+
+    // Returns the index of the call's reply.
+    template <class Method>
+    size_t add(const typename Method::Request &request) {
+        call.assign(RPC_BINARY_PREFIX);
+        call += Method::route;
+        BinaryCodec::write(call, request);
+        appendNetstring(message, call);
+        return calls++;
+    }
+
+    size_t size() const { return calls; }
+
+    // Returns false if the server did not answer, or not with a reply for
+    // every call.
+    template <class Client>
+    bool send(Client &client, int timeout) {
+        replies.clear();
+        auto reply = client.sendMessage(message, timeout);
+        if (!reply) {
+            return false;
+        }
+        answer = std::move(*reply);
+        std::string_view in = answer;
+        std::string_view part;
+        while (!in.empty() && readNetstring(in, part)) {
+            replies.push_back(part);
+        }
+        if (!in.empty() || replies.size() != calls) {
+            replies.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // The reply to call index, as rpcCall would return it: nullopt if the
+    // call got no reply.
+    template <class Method>
+    std::optional<typename Method::Response> reply(
+        size_t index, std::chrono::milliseconds *next_poll = nullptr) const {
+        if (next_poll) {
+            *next_poll = std::chrono::milliseconds::zero();
+        }
+        if (index >= replies.size() || replies[index].empty()) {
+            return std::nullopt;
+        }
+        typename Method::Response response;
+        uint32_t next_poll_ms = 0;
+        if (!BinaryCodec::readResponse(replies[index], response,
+                                       &next_poll_ms)) {
+            rpcReset(response);
+            response.status = RpcStatus::Error;
+            next_poll_ms = 0;
+        }
+        if (next_poll) {
+            *next_poll = std::chrono::milliseconds(next_poll_ms);
+        }
+        return response;
+    }
+
+   private:
+    std::string message;
+    std::string call;
+    size_t calls = 0;
+    std::string answer;
+    std::vector<std::string_view> replies;  // into answer
+};
+
+// How long a client waits before polling again: the server's advice, kept
+// under longest so that a confused server cannot stall the client, or
+// fallback if the server gave none.
+inline std::chrono::milliseconds rpcPollDelay(
+    std::chrono::milliseconds advice, std::chrono::milliseconds fallback,
+    std::chrono::milliseconds longest) {
+    return advice.count() > 0 ? std::min(advice, longest) : fallback;
+}
+
+#endif  // RPC_HPP
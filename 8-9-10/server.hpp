@@ -0,0 +1,644 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <netinet/in.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flower_simulation.hpp"
+#include "flowerbed_state_manager.hpp"
+#include "garden_rpc.hpp"
+#include "monitor_report.hpp"
+#include "route_manager.hpp"
+#include "udp_server.hpp"
+
+// The garden server: the routes over the shared state, and the threads that
+// push changes, expire waits and simulate the flowers.
+class Server : public UDPServer {
+   public:
+    // A positive tick period turns on the server side simulation of the
+    // flowers drying out.
+    Server(uint16_t port, size_t flowerCount, std::chrono::milliseconds tick,
+           const GardenerPolicy &gardenerPolicy)
+        : UDPServer(port), stateManager(flowerCount, gardenerPolicy) {
+        rpc.on<PingGardener>(
+            [this](const std::string &client_id, const PingGardener::Request &,
+                   PingGardener::Response &response) {
+                handleGardenerPing(client_id, response);
+            },
+            pingPacer<PingGardener>());
+        rpc.on<PingFlowerbed>(
+            [this](const std::string &, const PingFlowerbed::Request &,
+                   PingFlowerbed::Response &response) {
+                handleFlowerbedPing(response);
+            },
+            pingPacer<PingFlowerbed>());
+        rpc.on<GetUpdates>(
+            [this](const std::string &client_id,
+                   const GetUpdates::Request &request,
+                   GetUpdates::Response &response) {
+                handleGetUpdates(client_id, request, response);
+            },
+            [](const std::string &, const GetUpdates::Response &response) {
+                return response.status == RpcStatus::Ok &&
+                               response.updates.empty()
+                           ? QUIET_UPDATES_POLL
+                           : std::chrono::milliseconds::zero();
+            });
+        rpc.on<FlowerCount>([this](const std::string &,
+                                   const FlowerCount::Request &,
+                                   FlowerCount::Response &response) {
+            response.count = stateManager.flowerCount();
+        });
+        rpc.on<GetFlower>(
+            [this](const std::string &client_id, const GetFlower::Request &,
+                   GetFlower::Response &response) {
+                handleGardenerRequest(client_id, response);
+            },
+            [this](const std::string &, const GetFlower::Response &response) {
+                return workPollDelay(response.status, response.flower >= 0);
+            });
+        rpc.onDeferrable<GetFlowers>(
+            [this](const std::string &client_id,
+                   const GetFlowers::Request &request,
+                   GetFlowers::Response &response, auto defer) {
+                handleGardenerBatchRequest(client_id, request, response,
+                                           defer);
+            },
+            [this](const std::string &, const GetFlowers::Response &response) {
+                return workPollDelay(response.status,
+                                     !response.flowers.empty());
+            });
+        rpc.on<WaterFlower>([this](const std::string &,
+                                   const WaterFlower::Request &request,
+                                   WaterFlower::Response &response) {
+            handleGardenerWatered(request, response);
+        });
+        rpc.on<ToWater>(
+            [this](const std::string &, const ToWater::Request &request,
+                   ToWater::Response &response) {
+                handleFlowerbedNewFlowers(request, response);
+            },
+            [this](const std::string &, const ToWater::Response &response) {
+                return response.status == RpcStatus::Ok
+                           ? newFlowersDelay()
+                           : std::chrono::milliseconds::zero();
+            });
+        rpc.on<Monitor>(
+            [this](const std::string &client_id,
+                   const Monitor::Request &request,
+                   Monitor::Response &response) {
+                handleMonitorRequest(client_id, request, response);
+            },
+            [](const std::string &, const Monitor::Response &response) {
+                return response.status == RpcStatus::NotModified
+                           ? QUIET_MONITOR_POLL
+                           : std::chrono::milliseconds::zero();
+            });
+        rpc.on<Subscribe>([this](const std::string &client_id,
+                                 const struct sockaddr_in &addr,
+                                 const Subscribe::Request &request,
+                                 Subscribe::Response &response) {
+            handleSubscribe(client_id, addr, request, response);
+        });
+        // Replaces the text route of Monitor: the rendered report is shared
+        // by all the monitors that poll between two changes.
+        routeManager.registerRoute(
+            std::string(Monitor::route),
+            [this](const std::string &client_id, struct sockaddr_in &,
+                   std::string_view, std::string_view suffix,
+                   ResponseBuffer &response) {
+                handleMonitorText(client_id, suffix, response);
+            });
+        routeManager.registerBatchRoute(
+            std::string(RPC_BATCH_ROUTE),
+            [this](const std::string &client_id, std::string_view call) {
+                return admitRoute(client_id, call);
+            });
+
+        // Generous enough for the stock clients, tight enough that a client
+        // stuck in a retry loop or polling too often cannot starve the rest.
+        // Text and binary routes of a method share the same limits.
+        auto setMethodRateLimit = [this](const std::string &prefix,
+                                         const RateLimit &limit) {
+            setRouteClassRateLimit(prefix, limit);
+            setRouteClassRateLimit(std::string(RPC_BINARY_PREFIX) + prefix,
+                                   limit);
+        };
+        setAddressRateLimit({2000, 4000});
+        setConnectionRateLimit({200, 400});
+        setMethodRateLimit("/ping/", {2, 5});
+        setMethodRateLimit("/monitor/", {2, 5});
+        setMethodRateLimit("/flowerCount/", {2, 5});
+        setMethodRateLimit("/getFlower/", {5, 10});
+        setMethodRateLimit("/water/", {5, 10});
+        setMethodRateLimit("/getUpdates/", {5, 10});
+        setMethodRateLimit("/toWater/", {2, 5});
+        setMethodRateLimit("/subscribe/", {2, 5});
+        // A batch is charged once, and each of its calls once more to its
+        // own method, see registerBatchRoute.
+        setRouteClassRateLimit(std::string(RPC_BATCH_ROUTE), {2, 5});
+
+        worker_thread = std::jthread([this](std::stop_token stop_token) {
+            while (!stop_token.stop_requested()) {
+                stateManager.checkConnections();
+
+                if (!stateManager.isReady()) {
+                    std::cout << "Waiting for all clients to be connected..."
+                              << std::endl;
+                } else {
+                    std::cout << "All clients are connected. Ready to operate."
+                              << std::endl;
+                }
+
+                auto drops = getRateLimiterStats();
+                if (drops.dropped_by_address || drops.dropped_by_connection ||
+                    drops.dropped_by_route_class) {
+                    std::cout << "[INFO] Rate limited frames: by address "
+                              << drops.dropped_by_address
+                              << ", by connection "
+                              << drops.dropped_by_connection
+                              << ", by route class "
+                              << drops.dropped_by_route_class << std::endl;
+                }
+
+                std::this_thread::sleep_for(std::chrono::seconds(10));
+            }
+        });
+
+        push_thread = std::jthread(
+            [this](std::stop_token stop_token) { pushChanges(stop_token); });
+
+        waiter_thread = std::jthread([this](std::stop_token stop_token) {
+            while (!stop_token.stop_requested()) {
+                std::this_thread::sleep_for(WAIT_RESOLUTION);
+                stateManager.expireWaiters();
+            }
+        });
+
+        if (tick.count() > 0) {
+            simulation = std::make_unique<FlowerSimulation>(flowerCount, tick);
+            simulation_thread = std::jthread(
+                [this](std::stop_token stop_token) { simulate(stop_token); });
+        }
+    }
+
+    void handleMessage(const std::string &client_id,
+                       struct sockaddr_in &client_addr,
+                       std::string_view message) override {
+        std::cout << "[INFO] Recieved { " << message << " } from " << client_id
+                  << std::endl;
+        // One response buffer per handler thread, reused for every request.
+        thread_local ResponseBuffer response;
+        response.clear();
+        if (routeManager.handleRoute(client_id, client_addr, message,
+                                     response) &&
+            !response.deferred()) {
+            sendMessage(client_id, client_addr, response.view());
+        }
+    }
+
+   private:
+    // Assumed for flowers the flowerbed sends without a drying time.
+    static constexpr std::chrono::milliseconds DEFAULT_DRYING_TIME =
+        std::chrono::seconds(60);
+    // Most flowers handed out by one /getFlower/?n= request.
+    static constexpr size_t MAX_BATCH = 64;
+    // Longest a /getFlower/?n= request waits for work, kept under the
+    // timeout of the stock clients.
+    static constexpr std::chrono::milliseconds MAX_WAIT =
+        std::chrono::seconds(8);
+    // How often requests that waited long enough are answered.
+    static constexpr std::chrono::milliseconds WAIT_RESOLUTION =
+        std::chrono::milliseconds(100);
+    // Changes that come in a burst are pushed together.
+    static constexpr std::chrono::milliseconds PUSH_COALESCE_WINDOW =
+        std::chrono::milliseconds(20);
+    // Pushes refused while a subscriber had too much in flight are retried
+    // at least this often.
+    static constexpr std::chrono::milliseconds PUSH_RETRY_INTERVAL =
+        std::chrono::milliseconds(500);
+
+    // Advice to binary clients on when to poll again, see RpcPacer. Pings
+    // only have to beat the heartbeat timeout, with one to spare.
+    static constexpr std::chrono::milliseconds PING_INTERVAL =
+        ConnectionRegistry::HEARTBEAT_TIMEOUT / 2;
+    // A gardener that found nothing to do, in a garden with no work left,
+    // waits this long before it asks again.
+    static constexpr std::chrono::milliseconds IDLE_WORK_POLL =
+        std::chrono::seconds(5);
+    static constexpr std::chrono::milliseconds QUIET_UPDATES_POLL =
+        std::chrono::seconds(3);
+    static constexpr std::chrono::milliseconds QUIET_MONITOR_POLL =
+        std::chrono::seconds(2);
+    // The flowerbed's rounds of new flowers, stretched up to MAX_BACKOFF
+    // times while the gardeners have more work than they can take at once.
+    static constexpr std::chrono::milliseconds NEW_FLOWERS_INTERVAL =
+        std::chrono::seconds(30);
+    static constexpr size_t MAX_BACKOFF = 4;
+
+    // A connection follows one topic, see Subscribe.
+    struct Subscriber {
+        bool updates = false;  // otherwise the monitor report
+        uint64_t cursor = 0;   // of the updates pushed so far
+        uint64_t monitor_version = 0;
+        // The log is confirmed up to unconfirmed_cursor once the push
+        // frames before unconfirmed_end are acknowledged.
+        bool unconfirmed = false;
+        uint64_t unconfirmed_cursor = 0;
+        uint32_t unconfirmed_end = 0;
+    };
+
+    RouteManager routeManager;
+    RpcRouter rpc{routeManager, *this};
+    FlowerBedStateManager stateManager;
+    std::jthread worker_thread;
+    std::jthread waiter_thread;
+    std::mutex subscribers_mutex;
+    std::unordered_map<std::string, Subscriber> subscribers;
+    std::atomic<std::shared_ptr<const MonitorReport>> report;
+    std::jthread push_thread;
+    std::unique_ptr<FlowerSimulation> simulation;
+    std::jthread simulation_thread;
+
+    void simulate(std::stop_token stop_token) {
+        FlowerSimulation::Events events;
+        auto next_tick = DeadlineQueue::Clock::now();
+        while (!stop_token.stop_requested()) {
+            // A tick that overran is not made up for with a burst of them.
+            next_tick = std::max(next_tick + simulation->tickPeriod(),
+                                 DeadlineQueue::Clock::now());
+            std::this_thread::sleep_until(next_tick);
+            // Flowers only dry out while the garden is tended.
+            if (!stateManager.isReady()) {
+                continue;
+            }
+            simulation->tick(next_tick, events);
+            stateManager.reportThirsty(events.thirsty);
+            stateManager.reportDead(events.dead);
+        }
+    }
+
+    template <class Method>
+    static RpcPacer<Method> pingPacer() {
+        return [](const std::string &,
+                  const typename Method::Response &response) {
+            return response.status == RpcStatus::Error
+                       ? std::chrono::milliseconds::zero()
+                       : PING_INTERVAL;
+        };
+    }
+
+    // A gardener that got work comes back as soon as it is done, so a busy
+    // garden turns around fast; one that got none while the garden is idle
+    // backs off. If flowers are only leased out they may come back soon.
+    std::chrono::milliseconds workPollDelay(RpcStatus status, bool got_work) {
+        if (status != RpcStatus::Ok || got_work || stateManager.backlog()) {
+            return std::chrono::milliseconds::zero();
+        }
+        return IDLE_WORK_POLL;
+    }
+
+    // Backlog measured in rounds of MAX_BATCH for every gardener.
+    std::chrono::milliseconds newFlowersDelay() {
+        size_t round =
+            MAX_BATCH *
+            static_cast<size_t>(std::max(1, stateManager.gardenerCount()));
+        size_t backoff =
+            std::min(MAX_BACKOFF, 1 + stateManager.backlog() / round);
+        return NEW_FLOWERS_INTERVAL * static_cast<int64_t>(backoff);
+    }
+
+    void handleGardenerPing(const std::string &client_id,
+                            PingGardener::Response &response) {
+        if (stateManager.addGardener(client_id)) {
+            return;
+        }
+        std::cerr << "Gardener limit reached, rejecting: " << client_id
+                  << std::endl;
+        response.status = RpcStatus::Error;
+    }
+
+    void handleFlowerbedPing(PingFlowerbed::Response &response) {
+        if (!stateManager.setFlowerbedConnected(true)) {
+            // has connection already, handle ownership of flowerbed on
+            // client side -- client must receive OK once
+            response.status = RpcStatus::AlreadyConnected;
+        }
+    }
+
+    void handleGetUpdates(const std::string &client_id,
+                          const GetUpdates::Request &request,
+                          GetUpdates::Response &response) {
+        if (!stateManager.isReady()) {
+            response.status = RpcStatus::NotReady;
+            return;
+        }
+        thread_local std::vector<UpdateLog::Update> updates;
+        thread_local std::vector<UpdateLog::Run> runs;
+        runs.clear();
+        if (request.cursor) {
+            auto result =
+                stateManager.readUpdates(*request.cursor, updates, runs);
+            response.cursor = result.cursor;
+            response.resync = result.resync;
+        } else {
+            stateManager.readUpdates(client_id, updates);
+        }
+        fillUpdates(response, updates, runs);
+    }
+
+    static void fillUpdates(GetUpdates::Response &response,
+                            std::span<const UpdateLog::Update> updates,
+                            std::span<const UpdateLog::Run> runs) {
+        for (const auto &[flowerIndex, flowerState] : updates) {
+            response.updates.push_back({flowerIndex, flowerState});
+        }
+        for (const auto &run : runs) {
+            response.runs.push_back({run.first, run.count, run.state});
+        }
+    }
+
+    void handleGardenerRequest(const std::string &client_id,
+                               GetFlower::Response &response) {
+        if (!stateManager.isReady()) {
+            response.status = RpcStatus::NotReady;
+            return;
+        }
+        thread_local std::vector<size_t> flowers;
+        stateManager.getFlowersToWater(client_id, 1, flowers);
+        if (!flowers.empty()) {
+            response.flower = static_cast<int64_t>(flowers.front());
+        }
+    }
+
+    template <class Defer>
+    void handleGardenerBatchRequest(const std::string &client_id,
+                                    const GetFlowers::Request &request,
+                                    GetFlowers::Response &response,
+                                    Defer &defer) {
+        if (!stateManager.isReady()) {
+            response.status = RpcStatus::NotReady;
+            return;
+        }
+        size_t count = std::clamp<size_t>(request.count, 1, MAX_BATCH);
+        if (request.wait_ms == 0) {
+            stateManager.getFlowersToWater(client_id, count, response.flowers);
+            return;
+        }
+        // Deferred up front: the request may be completed on another thread
+        // before getFlowersOrWait returns.
+        auto wait = std::min<std::chrono::milliseconds>(
+            std::chrono::milliseconds(request.wait_ms), MAX_WAIT);
+        auto reply = defer();
+        stateManager.getFlowersOrWait(
+            client_id, count, wait, response.flowers,
+            [reply](std::span<const size_t> flowers) mutable {
+                GetFlowers::Response later;
+                later.flowers.assign(flowers.begin(), flowers.end());
+                reply.send(later);
+            });
+        if (!response.flowers.empty()) {
+            reply.send(response);
+        }
+    }
+
+    void handleGardenerWatered(const WaterFlower::Request &request,
+                               WaterFlower::Response &response) {
+        if (!stateManager.isReady()) {
+            response.status = RpcStatus::NotReady;
+            return;
+        }
+        // Only the flowers this report watered: a retried report must not
+        // count towards growth twice.
+        thread_local std::vector<size_t> newly;
+        if (!stateManager.reportWatered(request.flowers, newly)) {
+            response.status = RpcStatus::Error;
+            return;
+        }
+        if (simulation && !newly.empty()) {
+            simulation->water(newly);
+        }
+    }
+
+    void handleFlowerbedNewFlowers(const ToWater::Request &request,
+                                   ToWater::Response &response) {
+        if (!stateManager.isReady()) {
+            response.status = RpcStatus::NotReady;
+            return;
+        }
+        auto now = DeadlineQueue::Clock::now();
+        thread_local std::vector<DeadlineQueue::Entry> flowers;
+        flowers.clear();
+        for (const auto &[flower, dries_in_ms] : request.flowers) {
+            auto dries_in = dries_in_ms
+                                ? std::chrono::milliseconds(*dries_in_ms)
+                                : DEFAULT_DRYING_TIME;
+            flowers.push_back({now + dries_in, flower});
+        }
+        if (!stateManager.addFlowersToWater(flowers)) {
+            response.status = RpcStatus::Error;
+        }
+    }
+
+    void handleSubscribe(const std::string &client_id,
+                         const struct sockaddr_in &addr,
+                         const Subscribe::Request &request,
+                         Subscribe::Response &response) {
+        bool updates = request.topic == Subscribe::UPDATES;
+        if (!updates && request.topic != Subscribe::MONITOR) {
+            response.status = RpcStatus::Error;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(subscribers_mutex);
+        Subscriber &subscriber = subscribers[client_id];
+        subscriber = {};
+        subscriber.updates = updates;
+        if (updates) {
+            subscriber.cursor =
+                request.cursor.value_or(stateManager.updatesHead());
+        } else {
+            // A monitor renewing a quiet subscription has seen the latest
+            // report already, and is not sent it again. A version ahead of
+            // ours was seen before the server restarted.
+            uint64_t seen = request.cursor.value_or(0);
+            subscriber.monitor_version =
+                seen <= monitorReport()->version() ? seen : 0;
+            stateManager.updateNonitorConnection(client_id);
+        }
+        // The stream starts over, so whatever the subscriber has not seen is
+        // sent again, and nothing if it has seen it all.
+        response.first_push = openPush(client_id, addr);
+        if (updates) {
+            pushUpdates(client_id, subscriber);
+        } else {
+            pushReport(monitorReport());
+        }
+    }
+
+    void pushChanges(std::stop_token stop_token) {
+        uint64_t seen = 0;
+        while (!stop_token.stop_requested()) {
+            stateManager.waitForSnapshot(seen, PUSH_RETRY_INTERVAL);
+            std::this_thread::sleep_for(PUSH_COALESCE_WINDOW);
+            auto current = monitorReport();
+            seen = current->version();
+
+            std::lock_guard<std::mutex> lock(subscribers_mutex);
+            pushReport(current);
+            for (auto it = subscribers.begin(); it != subscribers.end();) {
+                if (!it->second.updates || pushUpdates(it->first, it->second)) {
+                    ++it;
+                } else {
+                    it = subscribers.erase(it);
+                }
+            }
+        }
+    }
+
+    // The report of the latest snapshot, built once per version whoever
+    // asks for it first.
+    std::shared_ptr<const MonitorReport> monitorReport() {
+        auto snapshot = stateManager.getMonitorSnapshot();
+        auto cached = report.load(std::memory_order_acquire);
+        if (cached && cached->version() >= snapshot->version) {
+            return cached;
+        }
+        auto next = std::make_shared<const MonitorReport>(*snapshot);
+        // A report built from an older snapshot never replaces a newer one.
+        while (!cached || cached->version() < next->version()) {
+            if (report.compare_exchange_weak(cached, next,
+                                             std::memory_order_acq_rel)) {
+                break;
+            }
+        }
+        return next;
+    }
+
+    // Pushes the log after the subscriber's cursor, if there is anything,
+    // and confirms what earlier pushes delivered. Returns false if the
+    // subscriber stopped acknowledging pushes and should be dropped; it
+    // subscribes again once it notices.
+    bool pushUpdates(const std::string &client_id, Subscriber &subscriber) {
+        if (subscriber.unconfirmed &&
+            pushDelivered(client_id, subscriber.unconfirmed_end)) {
+            subscriber.unconfirmed = false;
+            stateManager.confirmUpdates(subscriber.unconfirmed_cursor);
+        }
+        // Unlike a poll, a push only reads the log once there is something
+        // new, so it does not publish snapshots by itself.
+        if (!stateManager.isReady() ||
+            stateManager.updatesHead() == subscriber.cursor) {
+            return true;
+        }
+        thread_local std::string message;
+        thread_local GetUpdates::Response response;
+        thread_local std::vector<UpdateLog::Update> updates;
+        thread_local std::vector<UpdateLog::Run> runs;
+        message.clear();
+        rpcReset(response);
+        auto result =
+            stateManager.readUpdates(subscriber.cursor, updates, runs);
+        response.cursor = result.cursor;
+        response.resync = result.resync;
+        fillUpdates(response, updates, runs);
+        message.append(Subscribe::UPDATES).append(";");
+        BinaryCodec::writeResponse(message, response);
+        uint32_t end = 0;
+        auto pushed = pushMessage(client_id, message, &end);
+        if (pushed == PushChannel::PushResult::Ok) {
+            // Resending is up to the push channel from here on, the log is
+            // confirmed once the client acknowledges. While an earlier push
+            // waits for that, this one is confirmed by a later one.
+            subscriber.cursor = result.cursor;
+            if (!subscriber.unconfirmed) {
+                subscriber.unconfirmed = true;
+                subscriber.unconfirmed_cursor = result.cursor;
+                subscriber.unconfirmed_end = end;
+            }
+        }
+        return pushed != PushChannel::PushResult::Unreachable;
+    }
+
+    // Sends the report to every monitor that has not seen it, all from the
+    // one encoded buffer, and drops the monitors that stopped acknowledging
+    // pushes. Called with subscribers_mutex held.
+    void pushReport(const std::shared_ptr<const MonitorReport> &current) {
+        thread_local std::vector<std::string> behind;
+        thread_local std::vector<PushChannel::PushResult> results;
+        behind.clear();
+        for (const auto &[client_id, subscriber] : subscribers) {
+            if (!subscriber.updates &&
+                subscriber.monitor_version < current->version()) {
+                behind.push_back(client_id);
+            }
+        }
+        if (behind.empty()) {
+            return;
+        }
+        // The frames share the report's buffer and keep it alive for as
+        // long as they may be resent.
+        pushToAll(behind, PushChannel::Message(current, &current->push()),
+                  results);
+        for (size_t i = 0; i < behind.size(); ++i) {
+            if (results[i] == PushChannel::PushResult::Unreachable) {
+                subscribers.erase(behind[i]);
+            } else if (results[i] == PushChannel::PushResult::Ok) {
+                subscribers[behind[i]].monitor_version = current->version();
+                stateManager.updateNonitorConnection(behind[i]);
+            }
+        }
+    }
+
+    // Whether a monitor that has seen version has seen the latest state.
+    // Only the published version is looked at, no report is built.
+    bool isCurrentReport(const std::optional<uint64_t> &version) {
+        return version &&
+               *version == stateManager.getMonitorSnapshot()->version;
+    }
+
+    void handleMonitorRequest(const std::string &client_id,
+                              const Monitor::Request &request,
+                              Monitor::Response &response) {
+        stateManager.updateNonitorConnection(client_id);
+        if (isCurrentReport(request.version)) {
+            response.status = RpcStatus::NotModified;
+            return;
+        }
+        response = monitorReport()->state();
+    }
+
+    void handleMonitorText(const std::string &client_id,
+                           std::string_view suffix, ResponseBuffer &response) {
+        Monitor::Request request;
+        if (!TextCodec::read(suffix, request)) {
+            response.append(rpcStatusWord(RpcStatus::Error));
+            return;
+        }
+        stateManager.updateNonitorConnection(client_id);
+        if (isCurrentReport(request.version)) {
+            response.append(rpcStatusWord(RpcStatus::NotModified));
+            return;
+        }
+        auto current = monitorReport();
+        if (request.version) {
+            // The version to ask with next time.
+            response.append("@").appendNumber(current->version()).append(";");
+        }
+        response.append(current->text());
+    }
+};
+
+#endif  // SERVER_HPP
@@ -0,0 +1,62 @@
+#ifndef SESSION_FILE_HPP
+#define SESSION_FILE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "udp_client.hpp"
+
+// A client's session kept in a file across restarts: the client id on the
+// first line, the resumption ticket on the second. A client started with
+// one resumes its session with its first message instead of a handshake.
+// Without a path nothing is read or written.
+class SessionFile {
+   public:
+    explicit SessionFile(std::string path = {}) : path(std::move(path)) {}
+
+    std::optional<SessionTicket> load() const {
+        if (path.empty()) {
+            return std::nullopt;
+        }
+        std::ifstream in(path);
+        SessionTicket session;
+        if (!std::getline(in, session.client_id) ||
+            !std::getline(in, session.ticket) || session.client_id.empty() ||
+            session.ticket.empty()) {
+            return std::nullopt;
+        }
+        return session;
+    }
+
+    // Writes the session once the server has issued a ticket, and again
+    // only when it changed.
+    void save(const SessionTicket &session) {
+        if (path.empty() || session.ticket.empty() ||
+            (session.client_id == saved.client_id &&
+             session.ticket == saved.ticket)) {
+            return;
+        }
+        std::ofstream out(path, std::ios::trunc);
+        if (out << session.client_id << '\n' << session.ticket << '\n') {
+            saved = session;
+        }
+    }
+
+    // A client resuming the saved session, or a new one after a handshake.
+    UDPClient connect(const std::string &server_ip,
+                      uint16_t server_port) const {
+        if (auto session = load()) {
+            return UDPClient(server_ip, server_port, *session);
+        }
+        return UDPClient(server_ip, server_port);
+    }
+
+   private:
+    std::string path;
+    SessionTicket saved;
+};
+
+#endif  // SESSION_FILE_HPP
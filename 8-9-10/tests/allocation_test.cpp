@@ -0,0 +1,172 @@
+// Counts the heap allocations of the steady-state request path: a gardener
+// takes a flower with /getFlower/ and reports it with /water/N. Both must run
+// without a single allocation once the server is warmed up. Fails with the
+// count otherwise.
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "server.hpp"
+
+namespace {
+
+// Only the test thread counts, the server's own threads run as they like.
+thread_local bool counting = false;
+std::atomic<long> allocations{0};
+
+void *allocate(std::size_t size) noexcept {
+    if (counting) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+// aligned_alloc wants the size to be a multiple of the alignment.
+void *allocate(std::size_t size, std::align_val_t align) noexcept {
+    if (counting) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto alignment = static_cast<std::size_t>(align);
+    size = (size == 0 ? 1 : size) + alignment - 1;
+    return std::aligned_alloc(alignment, size - size % alignment);
+}
+
+}  // namespace
+
+// Every form of new and delete is replaced, so that none escapes the count
+// and all of them end in malloc and free. GCC cannot tell the pair matches
+// once the replacements are inlined, hence the pragma.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(std::size_t size) {
+    if (void *p = allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, std::align_val_t align) {
+    if (void *p = allocate(size, align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+    return allocate(size, align);
+}
+
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+    return allocate(size, align);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+int main() {
+    constexpr size_t FLOWERS = 256;
+    constexpr int WARMUP_ROUNDS = 2;
+
+    // Requests are logged to std::cout, which would only be noise here.
+    std::cout.setstate(std::ios::failbit);
+
+    Server server(0, FLOWERS, std::chrono::milliseconds(0), GardenerPolicy{});
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9);  // discard, the replies go nowhere
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    std::string flowerbed = "flowerbed";
+    std::string gardeners[] = {"gardener-1", "gardener-2"};
+    std::string to_water = "/toWater/";
+    std::vector<std::string> water;
+    for (size_t flower = 0; flower < FLOWERS; ++flower) {
+        to_water += std::to_string(flower) + ";";
+        water.push_back("/water/" + std::to_string(flower));
+    }
+
+    server.handleMessage(flowerbed, addr, "/ping/flowerbed/");
+    for (auto &gardener : gardeners) {
+        server.handleMessage(gardener, addr, "/ping/gardener/");
+    }
+
+    // Every flower is queued, handed out and watered, so that the first
+    // round fills the buffers and pools the next ones reuse.
+    auto round = [&] {
+        for (size_t flower = 0; flower < FLOWERS; ++flower) {
+            std::string &gardener = gardeners[flower % 2];
+            server.handleMessage(gardener, addr, "/getFlower/");
+            server.handleMessage(gardener, addr, water[flower]);
+        }
+    };
+    for (int i = 0; i < WARMUP_ROUNDS; ++i) {
+        server.handleMessage(flowerbed, addr, to_water);
+        round();
+    }
+    server.handleMessage(flowerbed, addr, to_water);
+
+    counting = true;
+    round();
+    counting = false;
+
+    long counted = allocations.load();
+    std::fprintf(stderr, "%zu x (/getFlower/ + /water/N): %ld allocations\n",
+                 FLOWERS, counted);
+    // The server's threads are not joined, they may sleep for seconds.
+    std::_Exit(counted == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
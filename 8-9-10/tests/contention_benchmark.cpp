@@ -0,0 +1,101 @@
+// Runs 1, 2, 4, ... handler threads against one FlowerBedStateManager, each
+// acting as a gardener: take flowers, report them watered and queue them
+// again, as the flowerbed would. A monitor thread meanwhile reads a snapshot
+// every 20 ms. Prints the throughput for every thread count. Scaling only
+// shows on a machine with at least as many cores as threads.
+//
+//     8-contention-benchmark [max_threads] [seconds_per_run]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flowerbed_state_manager.hpp"
+
+namespace {
+
+constexpr size_t FLOWERS = 64 * WorkQueue::MIN_SHARD_FLOWERS;
+constexpr size_t BATCH = 8;
+
+double run(size_t thread_count, std::chrono::milliseconds duration) {
+    GardenerPolicy policy;
+    policy.min_gardeners = 1;
+    policy.needs_flowerbed = false;
+    FlowerBedStateManager state(FLOWERS, policy);
+
+    std::vector<DeadlineQueue::Entry> all;
+    auto deadline = DeadlineQueue::Clock::now() + std::chrono::minutes(10);
+    for (size_t flower = 0; flower < FLOWERS; ++flower) {
+        all.push_back({deadline, flower});
+    }
+    state.addFlowersToWater(all);
+
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> watered{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, id = "gardener-" + std::to_string(i)] {
+            state.addGardener(id);
+            std::vector<size_t> flowers;
+            std::vector<size_t> newly;
+            std::vector<DeadlineQueue::Entry> again;
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (!state.isReady()) {
+                    continue;
+                }
+                state.getFlowersToWater(id, BATCH, flowers);
+                state.reportWatered(flowers, newly);
+                again.clear();
+                for (size_t flower : flowers) {
+                    again.push_back({deadline, flower});
+                }
+                state.addFlowersToWater(again);
+                count += flowers.size();
+            }
+            watered.fetch_add(count);
+        });
+    }
+    std::thread monitor([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            state.getMonitorSnapshot();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    });
+
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    monitor.join();
+    return watered.load() / std::chrono::duration<double>(duration).count();
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    size_t max_threads =
+        argc >= 2 ? std::stoul(argv[1])
+                  : std::max(4u, std::thread::hardware_concurrency());
+    auto duration = std::chrono::milliseconds(
+        argc >= 3 ? static_cast<long>(std::stod(argv[2]) * 1000) : 1000);
+
+    std::printf("%zu flowers, batches of %zu, %u hardware threads\n", FLOWERS,
+                BATCH, std::thread::hardware_concurrency());
+    std::printf("%8s %16s %8s\n", "threads", "flowers/s", "speedup");
+    double base = 0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = run(threads, duration);
+        if (threads == 1) {
+            base = rate;
+        }
+        std::printf("%8zu %16.0f %8.2f\n", threads, rate, rate / base);
+    }
+    return EXIT_SUCCESS;
+}
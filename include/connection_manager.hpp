@@ -2,20 +2,23 @@
 #define CONNECTION_MANAGER_H
 
 #include <ctime>
+#include <memory_resource>
 #include <queue>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "message_dispatcher.hpp"
+#include "string_hash.hpp"
 
 class ConnectionManager {
    public:
     ConnectionManager();
-    void registerClient(const std::string& client_id);
-    void trackSegment(const std::string& client_id, uint32_t seq_num,
-                      uint32_t total_segments, const std::string& payload);
-    void assembleMessage(const std::string& client_id,
-                         std::string& complete_message);
+    void registerClient(std::string_view client_id);
+    void trackSegment(std::string_view client_id, uint32_t seq_num,
+                      uint32_t total_segments, std::string_view payload);
+    void assembleMessage(std::string_view client_id,
+                         std::pmr::string& complete_message);
     void removeInactiveClients();
     void setMessageHandler(MessageDispatcher* handler);
     MessageDispatcher* getMessageHandler() const;
@@ -23,11 +26,12 @@ class ConnectionManager {
    private:
     struct ClientState {
         std::unordered_map<uint32_t, std::string> segments;
-        uint32_t total_segments;
-        std::time_t last_active;
+        uint32_t total_segments = 0;
+        std::time_t last_active = 0;
     };
 
-    std::unordered_map<std::string, ClientState> clients;
+    std::unordered_map<std::string, ClientState, StringHash, std::equal_to<>>
+        clients;
     std::priority_queue<std::pair<std::time_t, std::string>,
                         std::vector<std::pair<std::time_t, std::string>>,
                         std::greater<>>
@@ -36,8 +40,9 @@ class ConnectionManager {
 
     static constexpr int INACTIVITY_TIMEOUT = 300;
 
-    void updateClientActivity(const std::string& client_id);
-    ClientState& getClientState(const std::string& client_id);
+    void updateClientActivity(std::string_view client_id,
+                              ClientState& client_state);
+    ClientState& getClientState(std::string_view client_id);
 };
 
 #endif  // CONNECTION_MANAGER_H
@@ -3,11 +3,12 @@
 
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 class ClientNotFoundException : public std::runtime_error {
    public:
-    explicit ClientNotFoundException(const std::string& id)
-        : std::runtime_error("Client not found: " + id) {}
+    explicit ClientNotFoundException(std::string_view id)
+        : std::runtime_error("Client not found: " + std::string(id)) {}
 };
 
 class IncompleteMessageException : public std::runtime_error {
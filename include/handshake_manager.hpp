@@ -1,26 +1,60 @@
 #ifndef HANDSHAKE_MANAGER_HPP
 #define HANDSHAKE_MANAGER_HPP
 
+#include <netinet/in.h>
+
+#include <array>
+#include <cstdint>
 #include <ctime>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
+
+#include "string_hash.hpp"
 
 class HandshakeManager {
    public:
-    void startHandshake(const std::string &client_id);
-    bool isHandshakeComplete(const std::string &client_id);
-    void completeHandshake(const std::string &client_id);
-    bool isClientKnown(const std::string &client_id);
-    void removeInactiveClients();
+    HandshakeManager();
+
+    // Stateless SYN-cookie style handshake: the cookie is a MAC over the
+    // client address and issue time, so nothing is stored until the client
+    // echoes a valid cookie back. The cookie doubles as the client id.
+    std::string issueCookie(const sockaddr_in &client_addr) const;
+    bool isCookieValid(std::string_view cookie,
+                       const sockaddr_in &client_addr) const;
+
+    // Resumption tickets are issued once a handshake completes and let a
+    // client restore its session with the first DATA frame after the server
+    // has forgotten it. They are bound to the client id, not the address.
+    std::string issueTicket(std::string_view client_id) const;
+    bool isTicketValid(std::string_view ticket,
+                       std::string_view client_id) const;
+
+    bool isHandshakeComplete(std::string_view client_id) const;
+    void completeHandshake(std::string_view client_id);
+    void updateClientActivity(std::string_view client_id);
+    bool isClientKnown(std::string_view client_id) const;
+    // Appends the ids of the clients it removed to removed.
+    void removeInactiveClients(std::vector<std::string> &removed);
 
    private:
     struct HandshakeState {
-        bool handshake_complete;
         std::time_t last_active;
     };
 
-    std::unordered_map<std::string, HandshakeState> handshakes;
+    std::unordered_map<std::string, HandshakeState, StringHash, std::equal_to<>>
+        handshakes;
+    std::array<uint64_t, 2> secret;
+
+    uint64_t cookieMac(const sockaddr_in &client_addr,
+                       uint32_t timestamp) const;
+    uint64_t ticketMac(std::string_view client_id, uint32_t timestamp) const;
+
     static constexpr int HANDSHAKE_TIMEOUT = 60;  // in seconds
+    static constexpr int COOKIE_LIFETIME = 60;    // in seconds
+    static constexpr int TICKET_LIFETIME = 24 * 60 * 60;  // in seconds
+    static constexpr size_t MAX_CLIENT_ID_LENGTH = 64;
 };
 
 #endif  // HANDSHAKE_MANAGER_HPP
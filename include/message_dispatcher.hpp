@@ -4,6 +4,7 @@
 #include <netinet/in.h>
 
 #include <string>
+#include <string_view>
 
 class MessageDispatcher {
    public:
@@ -11,10 +12,10 @@ class MessageDispatcher {
 
     virtual void handleMessage(const std::string& client_id,
                                struct sockaddr_in& client_addr,
-                               const std::string& message) = 0;
+                               std::string_view message) = 0;
     virtual void sendMessage(const std::string& client_id,
                              struct sockaddr_in& client_addr,
-                             const std::string& message) = 0;
+                             std::string_view message) = 0;
 };
 
 #endif  // MESSAGE_DISPATCHER_HPP
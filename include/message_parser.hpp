@@ -2,14 +2,16 @@
 #define MESSAGE_PARSER_H
 
 #include <functional>
+#include <memory_resource>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "messages.hpp"
 
-uint32_t computeChecksum(const std::string& data);
+uint32_t computeChecksum(std::string_view data);
 
 class ParseError : public std::runtime_error {
    public:
@@ -18,8 +20,8 @@ class ParseError : public std::runtime_error {
 
 class MessageParser {
    public:
-    using ParserFunction =
-        std::function<std::optional<ParsedMessage>(const std::string&)>;
+    using ParserFunction = std::function<std::optional<ParsedMessage>(
+        std::string_view, std::pmr::memory_resource*)>;
 
     static MessageParser& instance() {
         static MessageParser instance;
@@ -30,7 +32,9 @@ class MessageParser {
         parsers[type] = parser;
     }
 
-    std::optional<ParsedMessage> parseMessage(const std::string& message);
+    std::optional<ParsedMessage> parseMessage(
+        std::string_view message,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
    private:
     std::unordered_map<std::string, ParserFunction> parsers;
@@ -1,35 +1,56 @@
 #ifndef MESSAGES_H
 #define MESSAGES_H
 
+#include <memory_resource>
 #include <string>
 #include <variant>
 
+// String fields use polymorphic allocators so the server can parse straight
+// into a per-request arena; clients simply get the default resource.
 struct AckMessage {
-    std::string client_id;
+    std::pmr::string client_id;
     uint32_t seq_num;
+    std::pmr::string ticket;
 };
 struct NackMessage {
-    std::string client_id;
+    std::pmr::string client_id;
     uint32_t seq_num;
 };
 struct DataMessage {
-    std::string client_id;
+    std::pmr::string client_id;
+    std::pmr::string ticket;
     uint32_t seq_num;
     uint32_t total_segments;
     uint32_t checksum;
-    std::string payload;
+    std::pmr::string payload;
+};
+struct PushMessage {
+    std::pmr::string client_id;
+    uint32_t seq_num;
+    uint32_t segment;
+    uint32_t total_segments;
+    uint32_t checksum;
+    std::pmr::string payload;
+};
+struct PushAckMessage {
+    std::pmr::string client_id;
+    uint32_t seq_num;
 };
 struct InitRequest {};
 struct InitResponse {
-    std::string client_id;
+    std::pmr::string client_id;
 };
 struct HandshakeMessage {
-    std::string client_id;
+    std::pmr::string client_id;
+};
+struct HandshakeCompleteMessage {
+    std::pmr::string client_id;
+    std::pmr::string ticket;
 };
-struct HandshakeCompleteMessage {};
 
 using ParsedMessage =
-    std::variant<AckMessage, NackMessage, DataMessage, InitRequest,
-                 InitResponse, HandshakeMessage, HandshakeCompleteMessage>;
+    std::variant<AckMessage, NackMessage, DataMessage, PushMessage,
+                 PushAckMessage, InitRequest, InitResponse, HandshakeMessage,
+                 HandshakeCompleteMessage>;
 
 #endif  // MESSAGES_H
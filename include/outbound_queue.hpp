@@ -0,0 +1,62 @@
+#ifndef OUTBOUND_QUEUE_HPP
+#define OUTBOUND_QUEUE_HPP
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+// Bounded lock-free multi-producer/single-consumer ring of preformatted
+// frames. Producers copy a frame into a slot and wake the consumer through
+// an eventfd; the consumer sends ready slots in batches straight from the
+// ring. When the ring is full, producers are told so and may back off.
+class OutboundQueue {
+   public:
+    static constexpr size_t MAX_FRAME_SIZE = 1024;
+    static constexpr size_t MAX_BATCH = 32;
+
+    enum class PushResult { Ok, Full, TooLarge };
+
+    using BatchSender = std::function<void(mmsghdr *messages, unsigned count)>;
+
+    explicit OutboundQueue(size_t capacity);
+    ~OutboundQueue();
+
+    OutboundQueue(const OutboundQueue &) = delete;
+    OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+    // Producer side, safe to call from any thread.
+    PushResult tryPush(const sockaddr_in &addr, std::string_view frame);
+    PushResult push(const sockaddr_in &addr, std::string_view frame,
+                    std::chrono::milliseconds max_wait);
+
+    // Consumer side, only ever called from one thread.
+    int getEventFD() const;
+    size_t drain(const BatchSender &send_batch);
+
+   private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        sockaddr_in addr;
+        size_t length;
+        char data[MAX_FRAME_SIZE];
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    int event_fd;
+
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) size_t dequeue_pos;
+    alignas(64) std::atomic<bool> wakeup_pending;
+
+    void wakeConsumer();
+};
+
+#endif  // OUTBOUND_QUEUE_HPP
@@ -0,0 +1,125 @@
+#ifndef PUSH_CHANNEL_HPP
+#define PUSH_CHANNEL_HPP
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_hash.hpp"
+
+// Reliable server push. A message is split into PUSH frames numbered per
+// client, which are kept and resent until the client acknowledges each of
+// them with a PACK frame:
+//
+//     PUSH:<client_id>;PSEQ:<n>;SEG:<i>;TOT:<count>;CS:<sum>;DATA:<part>
+//     PACK: <client_id> SEQ: <n>
+//
+// The numbers of a client only grow, so the client puts frames back in
+// order and drops duplicates. A client that stays silent through
+// MAX_ATTEMPTS resends is given up on and forgotten until it is opened
+// again. Safe to use from any thread.
+//
+// Only the short header is per client: a frame is sent as the header and a
+// view into the message, which all the clients it went to share. Frames go
+// out in batches, a message pushed to many clients in a single one.
+class PushChannel {
+   public:
+    using Clock = std::chrono::steady_clock;
+    // Sends count datagrams, each a header and a body iovec.
+    using BatchSender = std::function<void(mmsghdr *messages, unsigned count)>;
+    using Message = std::shared_ptr<const std::string>;
+
+    enum class PushResult { Ok, Busy, Unreachable, TooLarge };
+
+    static constexpr size_t MAX_SEGMENT_SIZE = 512;
+    static constexpr size_t MAX_FRAME_SIZE = 1024;
+    // Frames in flight per client; past it a push is refused as Busy.
+    static constexpr size_t WINDOW = 32;
+    static constexpr auto RESEND_TIMEOUT = std::chrono::milliseconds(200);
+    static constexpr int MAX_ATTEMPTS = 10;
+
+    // Starts pushing to the client at addr, or starts over, dropping the
+    // frames in flight. Returns the number of the next frame: the client
+    // reads from there on.
+    uint32_t open(std::string_view client_id, const sockaddr_in &addr);
+
+    // On Ok, end is set to the number after the last frame of the message,
+    // see delivered.
+    PushResult push(std::string_view client_id, Message message,
+                    const BatchSender &send, uint32_t *end = nullptr);
+    // Pushes one message to every client in client_ids, results[i] telling
+    // how it went for client_ids[i].
+    void pushAll(std::span<const std::string> client_ids, Message message,
+                 const BatchSender &send, std::vector<PushResult> &results);
+    void acknowledge(std::string_view client_id, uint32_t seq_num);
+    // Whether the client acknowledged every frame numbered below seq_num.
+    // False for a client that is not open.
+    bool delivered(std::string_view client_id, uint32_t seq_num) const;
+    void resendExpired(Clock::time_point now, const BatchSender &send);
+    // Forgets the client and drops its frames in flight.
+    void close(std::string_view client_id);
+
+    // True while any client is open, the owner then has to call
+    // resendExpired regularly.
+    bool hasPeers() const;
+
+   private:
+    // Frame header without the client id, with every number at its widest.
+    static constexpr size_t MAX_HEADER_SIZE = 96;
+
+    struct Frame {
+        std::string header;
+        Message message;
+        std::string_view body;  // the segment of message
+        Clock::time_point sent;
+        int attempts;
+    };
+
+    struct Peer {
+        sockaddr_in addr;
+        uint32_t next_seq = 0;
+        std::map<uint32_t, Frame> in_flight;
+    };
+    using Peers =
+        std::unordered_map<std::string, Peer, StringHash, std::equal_to<>>;
+
+    // Frames to send, gathered under the lock and sent before it is let go.
+    struct Batch {
+        std::vector<std::pair<const sockaddr_in *, const Frame *>> frames;
+        std::vector<iovec> buffers;
+        std::vector<mmsghdr> messages;
+
+        void add(const Peer &peer, const Frame &frame) {
+            frames.emplace_back(&peer.addr, &frame);
+        }
+        void send(const BatchSender &send);
+    };
+
+    PushResult enqueue(std::string_view client_id, const Message &message,
+                       Clock::time_point now, Batch &batch);
+    // Called with the lock held.
+    Peers::iterator forget(Peers::iterator it);
+    void updatePeerCount();
+
+    mutable std::mutex mutex;
+    Peers peers;
+    // A client opened anew starts past the numbers of every client that was
+    // forgotten, so those of any one client still only grow.
+    uint32_t first_seq = 0;
+    std::atomic<size_t> peer_count{0};
+};
+
+#endif  // PUSH_CHANNEL_HPP
@@ -0,0 +1,101 @@
+#ifndef RATE_LIMITER_HPP
+#define RATE_LIMITER_HPP
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_hash.hpp"
+
+// A rate of zero means "unlimited".
+struct RateLimit {
+    double rate;   // tokens per second
+    double burst;  // bucket capacity
+};
+
+struct RateLimiterStats {
+    uint64_t dropped_by_address;
+    uint64_t dropped_by_connection;
+    uint64_t dropped_by_route_class;
+};
+
+class TokenBucket {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(const RateLimit &limit, Clock::time_point now);
+
+    bool tryConsume(Clock::time_point now);
+    Clock::time_point lastUsed() const;
+
+   private:
+    double rate;
+    double burst;
+    double tokens;
+    Clock::time_point last_refill;
+};
+
+// Admission control for the server loop. Packets are charged per source IP
+// before parsing, frames per connection once the sender is authenticated,
+// and messages (first segments) per connection and route class. Only
+// admitRoute may be called from other threads than the loop's.
+class RateLimiter {
+   public:
+    void setAddressLimit(const RateLimit &limit);
+    void setConnectionLimit(const RateLimit &limit);
+    void setRouteClassLimit(const std::string &prefix, const RateLimit &limit);
+
+    bool admitPacket(const sockaddr_in &client_addr);
+    bool admitSegment(std::string_view client_id, uint32_t seq_num,
+                      std::string_view payload);
+    // Charges a message that came inside another one, a call of a batch, to
+    // its route class.
+    bool admitRoute(std::string_view client_id, std::string_view message);
+    void removeIdleBuckets();
+
+    RateLimiterStats getStats() const;
+
+   private:
+    struct RouteClass {
+        std::string prefix;
+        RateLimit limit;
+    };
+
+    struct ConnectionBuckets {
+        TokenBucket frames;
+        std::vector<TokenBucket> route_classes;
+    };
+
+    RateLimit address_limit{0, 0};
+    RateLimit connection_limit{0, 0};
+    std::vector<RouteClass> route_classes;
+
+    std::unordered_map<in_addr_t, TokenBucket> address_buckets;
+    std::mutex connection_mutex;  // guards connection_buckets
+    std::unordered_map<std::string, ConnectionBuckets, StringHash,
+                       std::equal_to<>>
+        connection_buckets;
+    TokenBucket::Clock::time_point last_cleanup;
+
+    std::atomic<uint64_t> dropped_by_address{0};
+    std::atomic<uint64_t> dropped_by_connection{0};
+    std::atomic<uint64_t> dropped_by_route_class{0};
+
+    int findRouteClass(std::string_view payload) const;
+    // Called with connection_mutex held.
+    ConnectionBuckets &getConnectionBuckets(std::string_view client_id,
+                                            TokenBucket::Clock::time_point now);
+    bool admitRouteClass(ConnectionBuckets &buckets, std::string_view message,
+                         TokenBucket::Clock::time_point now);
+
+    static constexpr auto IDLE_TIMEOUT = std::chrono::seconds(60);
+};
+
+#endif  // RATE_LIMITER_HPP
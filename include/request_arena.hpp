@@ -0,0 +1,37 @@
+#ifndef REQUEST_ARENA_HPP
+#define REQUEST_ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Monotonic arena for the transient strings and containers of one request.
+// Everything allocated from it is freed at once when the arena goes out of
+// scope. Arenas are recycled through a per-thread pool, so a request only
+// reaches the heap if it outgrows the arena's inline buffer.
+class RequestArena {
+   public:
+    RequestArena();
+    ~RequestArena();
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    std::pmr::memory_resource *resource();
+
+   private:
+    static constexpr size_t BUFFER_SIZE = 16 * 1024;
+
+    struct Block {
+        alignas(std::max_align_t) std::byte buffer[BUFFER_SIZE];
+        std::pmr::monotonic_buffer_resource resource{
+            buffer, BUFFER_SIZE, std::pmr::new_delete_resource()};
+    };
+
+    std::unique_ptr<Block> block;
+
+    static std::vector<std::unique_ptr<Block>> &threadPool();
+};
+
+#endif  // REQUEST_ARENA_HPP
@@ -2,8 +2,9 @@
 #define SOCKET_MANAGER_H
 
 #include <netinet/in.h>
+#include <sys/socket.h>
 
-#include <string>
+#include <string_view>
 
 class SocketManager {
    public:
@@ -12,8 +13,8 @@ class SocketManager {
 
     void initSocket(uint16_t port);
     void bindSocket();
-    void sendMessage(const std::string &message,
-                     const sockaddr_in &client_addr);
+    void sendMessage(std::string_view message, const sockaddr_in &client_addr);
+    void sendBatch(mmsghdr *messages, unsigned int count);
     int receiveMessage(char *buffer, size_t buffer_size,
                        sockaddr_in &client_addr) const;
     int getSocketFD() const;
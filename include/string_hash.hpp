@@ -0,0 +1,18 @@
+#ifndef STRING_HASH_HPP
+#define STRING_HASH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
+// Transparent hash so maps keyed by std::string can be searched with any
+// string-like key without building a temporary std::string.
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const {
+        return std::hash<std::string_view>{}(key);
+    }
+};
+
+#endif  // STRING_HASH_HPP
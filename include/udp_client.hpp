@@ -4,6 +4,8 @@
 #include <netinet/in.h>
 #include <sys/epoll.h>
 
+#include <deque>
+#include <map>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -17,22 +19,58 @@ class TimeOutException : public std::runtime_error {
         : std::runtime_error(message) {}
 };
 
+// Everything a client needs to resume its session without a handshake.
+struct SessionTicket {
+    std::string client_id;
+    std::string ticket;
+};
+
 class UDPClient {
    public:
     UDPClient(const std::string &server_address, uint16_t server_port);
+    // Resumes a previous session: the ticket is presented with the first
+    // DATA frame, so no handshake round trips are made up front. A ticket
+    // the server no longer takes costs a fresh handshake instead.
+    UDPClient(const std::string &server_address, uint16_t server_port,
+              const SessionTicket &session);
     ~UDPClient();
 
     std::optional<std::string> sendMessage(const std::string &message,
                                            int timeout = 5);
+    // The session to resume after a restart. The ticket is empty until the
+    // server has issued one, with the answer to the first message.
+    SessionTicket getSessionTicket() const;
+
+    // Server push, see PushChannel. Once the server has opened a stream for
+    // this client, it has to be told the number of its first frame; pushes
+    // that arrive while other requests are in flight are kept until asked
+    // for.
+    void expectPushes(uint32_t first_seq);
+    // The next pushed message in the order the server sent them, nullopt if
+    // none comes within timeout seconds.
+    std::optional<std::string> receivePush(int timeout);
 
    private:
     int sockfd;
     int epoll_fd;
     struct sockaddr_in server_addr;
     std::string client_id;
+    std::string resumption_ticket;
     uint32_t seq_num;
+    bool handshake_restarted;
+
+    struct PushFrame {
+        uint32_t segment;
+        uint32_t total_segments;
+        std::string payload;
+    };
+    uint32_t next_push = 0;
+    std::map<uint32_t, PushFrame> push_frames;  // not yet in order
+    std::deque<std::string> pushes;             // complete, in order
 
     void initSocket();
+    void setServerAddress(const std::string &server_address,
+                          uint16_t server_port);
     bool performHandshake();
     bool sendAndReceiveAck(const std::string &message, int timeout);
     std::optional<std::string> receiveMessage(int timeout);
@@ -41,18 +79,20 @@ class UDPClient {
     uint32_t computeChecksum(const std::string &data);
 
     void sendSegment(const std::string &segment);
-    bool awaitAck(const std::string &segment, int timeout);
+    bool awaitAck(int timeout);
 
     void handleAck(const AckMessage &ack);
     void handleNack(const NackMessage &nack);
     void handleHandshake(const HandshakeMessage &hs);
     void handleHandshakeComplete(const HandshakeCompleteMessage &hsc);
+    void handlePush(const PushMessage &push);
+    void assemblePushes();
     std::optional<std::string> receiveResponse(int timeout);
 
     void setupEpoll();
     void handleEpollEvents();
 
-    bool handleEpollEvents(const std::string &current_segment, int timeout);
+    bool handleEpollEvents(int timeout);
 };
 
 #endif  // UDP_CLIENT_HPP
@@ -4,13 +4,22 @@
 #include <netinet/in.h>
 #include <sys/epoll.h>
 
+#include <chrono>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "connection_manager.hpp"
 #include "handshake_manager.hpp"
 #include "message_dispatcher.hpp"
 #include "messages.hpp"
+#include "outbound_queue.hpp"
+#include "push_channel.hpp"
+#include "rate_limiter.hpp"
 #include "socket_manager.hpp"
+#include "worker_pool.hpp"
 
 class UDPServer : public MessageDispatcher {
    public:
@@ -20,43 +29,94 @@ class UDPServer : public MessageDispatcher {
     void start();
     void stop();
 
+    // Pipeline mode: the epoll thread only frames, ACKs and reassembles.
+    // Complete messages are handled on a worker pool sharded by client id,
+    // and responses go back to the epoll thread through a lock-free ring.
+    void enablePipeline(size_t worker_count);
+
     void sendMessage(const std::string &client_id,
                      struct sockaddr_in &client_addr,
-                     const std::string &message) override;
+                     std::string_view message) override;
+
+    // Server push, see PushChannel. openPush returns the number of the first
+    // frame of the stream, which the client has to be told (in the reply to
+    // whatever request opened it) before it can read the pushes.
+    uint32_t openPush(const std::string &client_id,
+                      const struct sockaddr_in &client_addr);
+    PushChannel::PushResult pushMessage(const std::string &client_id,
+                                        std::string_view message,
+                                        uint32_t *end = nullptr);
+    bool pushDelivered(const std::string &client_id, uint32_t seq_num) const;
+    // One message to many clients: it is shared rather than copied for each
+    // and all the frames leave in one batch of sends.
+    void pushToAll(std::span<const std::string> client_ids,
+                   PushChannel::Message message,
+                   std::vector<PushChannel::PushResult> &results);
+
+    void setAddressRateLimit(const RateLimit &limit);
+    void setConnectionRateLimit(const RateLimit &limit);
+    void setRouteClassRateLimit(const std::string &prefix,
+                                const RateLimit &limit);
+    RateLimiterStats getRateLimiterStats() const;
+    // Charges a call that came inside another message, such as a batch, to
+    // the route class of its own route. Safe to call from handlers.
+    bool admitRoute(std::string_view client_id, std::string_view message);
 
    private:
     bool running;
     SocketManager socketManager;
     ConnectionManager connectionManager;
     HandshakeManager handshakeManager;
+    RateLimiter rateLimiter;
+    PushChannel pushChannel;
     int epoll_fd;
 
-    void handleClientMessage(const std::string &message,
+    std::unique_ptr<WorkerPool> workerPool;
+    std::unique_ptr<OutboundQueue> outboundQueue;
+
+    // Owned copy of the current sender's id for inline handlers, reused so
+    // its capacity survives between messages.
+    std::string current_client_id;
+    // Clients whose handshake expired in the last sweep.
+    std::vector<std::string> expired_clients;
+
+    static constexpr size_t MAX_SEGMENT_SIZE = 512;
+    static constexpr size_t OUTBOUND_QUEUE_CAPACITY = 1024;
+    static constexpr auto OUTBOUND_PUSH_TIMEOUT = std::chrono::seconds(1);
+    // How often unacknowledged push frames are looked at while any client
+    // is open for pushes.
+    static constexpr int PUSH_RESEND_INTERVAL_MS = 100;
+
+    void flushOutbound();
+
+    void handleClientMessage(std::string_view message,
                              struct sockaddr_in &client_addr);
     void handleAckMessage(const AckMessage &ack,
                           struct sockaddr_in &client_addr);
     void handleNackMessage(const NackMessage &nack,
                            struct sockaddr_in &client_addr);
+    void handlePushAckMessage(const PushAckMessage &ack);
+    void sendFrames(mmsghdr *messages, unsigned count);
     void handleDataMessage(const DataMessage &data,
-                           struct sockaddr_in &client_addr);
+                           struct sockaddr_in &client_addr,
+                           std::pmr::memory_resource *resource);
     void handleInitRequest(const InitRequest &init_request,
                            struct sockaddr_in &client_addr);
     void handleInitResponse(const InitResponse &init_response,
                             struct sockaddr_in &client_addr);
-    void sendInitResponseToClient(const std::string &client_id,
+    void sendInitResponseToClient(std::string_view client_id,
                                   struct sockaddr_in &client_addr);
-    void handleHandshakeMessage(const std::string &client_id,
+    void handleHandshakeMessage(std::string_view client_id,
                                 struct sockaddr_in &client_addr);
-    void sendAckToClient(const std::string &client_id, uint32_t seq_num,
-                         struct sockaddr_in &client_addr);
-    void sendNackToClient(const std::string &client_id, uint32_t seq_num,
+    void sendAckToClient(std::string_view client_id, uint32_t seq_num,
+                         struct sockaddr_in &client_addr,
+                         std::string_view ticket = {});
+    void sendNackToClient(std::string_view client_id, uint32_t seq_num,
                           struct sockaddr_in &client_addr);
-    void sendHandshakeToClient(const std::string &client_id,
+    void sendHandshakeToClient(std::string_view client_id,
                                struct sockaddr_in &client_addr);
-    void sendHandshakeCompleteToClient(const std::string &client_id,
+    void sendHandshakeCompleteToClient(std::string_view client_id,
                                        struct sockaddr_in &client_addr);
-
-    std::string generateClientId();
 };
 
 #endif  // UDP_SERVER_HPP
@@ -0,0 +1,37 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own queue. Tasks submitted
+// with the same key always land on the same worker, so they run in order.
+class WorkerPool {
+   public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(size_t worker_count);
+    ~WorkerPool();
+
+    void submit(std::string_view key, Task task);
+
+   private:
+    struct Worker {
+        std::mutex mtx;
+        std::condition_variable_any cv;
+        std::deque<Task> tasks;
+        std::jthread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    static void run(Worker &worker, std::stop_token stop_token);
+};
+
+#endif  // WORKER_POOL_HPP
@@ -4,7 +4,7 @@
 
 ConnectionManager::ConnectionManager() : messageHandler(nullptr) {}
 
-void ConnectionManager::registerClient(const std::string& client_id) {
+void ConnectionManager::registerClient(std::string_view client_id) {
     try {
         ClientState& client_state = getClientState(client_id);
         client_state.total_segments = 0;
@@ -13,22 +13,29 @@ void ConnectionManager::registerClient(const std::string& client_id) {
         ClientState new_client_state;
         new_client_state.total_segments = 0;
         new_client_state.segments.clear();
-        clients[client_id] = new_client_state;
+        clients.emplace(client_id, new_client_state);
     }
-    updateClientActivity(client_id);
+    updateClientActivity(client_id, getClientState(client_id));
 }
 
-void ConnectionManager::trackSegment(const std::string& client_id,
+void ConnectionManager::trackSegment(std::string_view client_id,
                                      uint32_t seq_num, uint32_t total_segments,
-                                     const std::string& payload) {
-    ClientState& client_state = getClientState(client_id);
-    client_state.segments[seq_num] = payload;
+                                     std::string_view payload) {
+    // Single-segment messages skip this path, so a client that sent only
+    // those for a while may have been dropped as inactive while its
+    // handshake is still valid. It is taken back instead of refused.
+    auto it = clients.find(client_id);
+    if (it == clients.end()) {
+        it = clients.emplace(std::string(client_id), ClientState{}).first;
+    }
+    ClientState& client_state = it->second;
+    client_state.segments[seq_num].assign(payload);
     client_state.total_segments = total_segments;
-    updateClientActivity(client_id);
+    updateClientActivity(client_id, client_state);
 }
 
-void ConnectionManager::assembleMessage(const std::string& client_id,
-                                        std::string& complete_message) {
+void ConnectionManager::assembleMessage(std::string_view client_id,
+                                        std::pmr::string& complete_message) {
     ClientState& client_state = getClientState(client_id);
     if (client_state.segments.size() != client_state.total_segments) {
         throw IncompleteMessageException();
@@ -67,15 +74,16 @@ MessageDispatcher* ConnectionManager::getMessageHandler() const {
     return messageHandler;
 }
 
-void ConnectionManager::updateClientActivity(const std::string& client_id) {
-    auto& client_state = clients[client_id];
+void ConnectionManager::updateClientActivity(std::string_view client_id,
+                                             ClientState& client_state) {
     client_state.last_active = std::time(nullptr);
 
-    inactiveClients.push(std::make_pair(client_state.last_active, client_id));
+    inactiveClients.push(
+        std::make_pair(client_state.last_active, std::string(client_id)));
 }
 
 ConnectionManager::ClientState& ConnectionManager::getClientState(
-    const std::string& client_id) {
+    std::string_view client_id) {
     auto it = clients.find(client_id);
     if (it == clients.end()) {
         throw ClientNotFoundException(client_id);
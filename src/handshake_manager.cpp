@@ -1,26 +1,187 @@
 #include "handshake_manager.hpp"
 
-void HandshakeManager::startHandshake(const std::string &client_id) {
-    handshakes[client_id] = {false, std::time(nullptr)};
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <random>
+
+namespace {
+
+// SipHash-2-4, a keyed PRF designed for short inputs. Used as the MAC of the
+// handshake cookies.
+uint64_t sipHash24(const std::array<uint64_t, 2> &key, const uint8_t *data,
+                   size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+    auto round = [&]() {
+        v0 += v1;
+        v1 = std::rotl(v1, 13);
+        v1 ^= v0;
+        v0 = std::rotl(v0, 32);
+        v2 += v3;
+        v3 = std::rotl(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = std::rotl(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = std::rotl(v1, 17);
+        v1 ^= v2;
+        v2 = std::rotl(v2, 32);
+    };
+
+    const size_t tail = len & 7;
+    const uint8_t *end = data + len - tail;
+    for (const uint8_t *p = data; p != end; p += 8) {
+        uint64_t m = 0;
+        for (int i = 0; i < 8; ++i) {
+            m |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+
+    uint64_t b = static_cast<uint64_t>(len) << 56;
+    for (size_t i = 0; i < tail; ++i) {
+        b |= static_cast<uint64_t>(end[i]) << (8 * i);
+    }
+    v3 ^= b;
+    round();
+    round();
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    round();
+    round();
+    round();
+    round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+void writeHex(char *out, uint64_t value, int digits) {
+    static constexpr char hex_digits[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; --i) {
+        out[i] = hex_digits[value & 0xf];
+        value >>= 4;
+    }
+}
+
+// Tokens look like <tag> <8 hex digits of issue time> <16 hex digits of MAC>.
+std::string makeToken(char tag, uint32_t timestamp, uint64_t mac) {
+    std::string token(25, tag);
+    writeHex(token.data() + 1, timestamp, 8);
+    writeHex(token.data() + 9, mac, 16);
+    return token;
+}
+
+bool parseToken(std::string_view token, char tag, uint32_t &timestamp,
+                uint64_t &mac) {
+    if (token.size() != 25 || token[0] != tag) {
+        return false;
+    }
+    const char *data = token.data();
+    return std::from_chars(data + 1, data + 9, timestamp, 16).ptr ==
+               data + 9 &&
+           std::from_chars(data + 9, data + 25, mac, 16).ptr == data + 25;
+}
+
+bool isFresh(uint32_t timestamp, uint32_t lifetime) {
+    auto now = static_cast<uint32_t>(std::time(nullptr));
+    return timestamp <= now && now - timestamp <= lifetime;
+}
+
+}  // namespace
+
+HandshakeManager::HandshakeManager() {
+    std::random_device rd;
+    for (auto &word : secret) {
+        word = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+}
+
+uint64_t HandshakeManager::cookieMac(const sockaddr_in &client_addr,
+                                     uint32_t timestamp) const {
+    uint8_t input[11] = {'C'};
+    std::memcpy(input + 1, &client_addr.sin_addr.s_addr, 4);
+    std::memcpy(input + 5, &client_addr.sin_port, 2);
+    std::memcpy(input + 7, &timestamp, 4);
+    return sipHash24(secret, input, sizeof(input));
+}
+
+uint64_t HandshakeManager::ticketMac(std::string_view client_id,
+                                     uint32_t timestamp) const {
+    uint8_t input[5 + MAX_CLIENT_ID_LENGTH] = {'T'};
+    std::memcpy(input + 1, &timestamp, 4);
+    size_t length = std::min(client_id.size(), MAX_CLIENT_ID_LENGTH);
+    std::memcpy(input + 5, client_id.data(), length);
+    return sipHash24(secret, input, 5 + length);
+}
+
+std::string HandshakeManager::issueCookie(
+    const sockaddr_in &client_addr) const {
+    auto timestamp = static_cast<uint32_t>(std::time(nullptr));
+    return makeToken('c', timestamp, cookieMac(client_addr, timestamp));
+}
+
+bool HandshakeManager::isCookieValid(std::string_view cookie,
+                                     const sockaddr_in &client_addr) const {
+    uint32_t timestamp = 0;
+    uint64_t mac = 0;
+    return parseToken(cookie, 'c', timestamp, mac) &&
+           isFresh(timestamp, COOKIE_LIFETIME) &&
+           mac == cookieMac(client_addr, timestamp);
+}
+
+std::string HandshakeManager::issueTicket(std::string_view client_id) const {
+    auto timestamp = static_cast<uint32_t>(std::time(nullptr));
+    return makeToken('t', timestamp, ticketMac(client_id, timestamp));
+}
+
+bool HandshakeManager::isTicketValid(std::string_view ticket,
+                                     std::string_view client_id) const {
+    uint32_t timestamp = 0;
+    uint64_t mac = 0;
+    return client_id.size() <= MAX_CLIENT_ID_LENGTH &&
+           parseToken(ticket, 't', timestamp, mac) &&
+           isFresh(timestamp, TICKET_LIFETIME) &&
+           mac == ticketMac(client_id, timestamp);
 }
 
-bool HandshakeManager::isHandshakeComplete(const std::string &client_id) {
-    return handshakes[client_id].handshake_complete;
+bool HandshakeManager::isHandshakeComplete(std::string_view client_id) const {
+    return handshakes.find(client_id) != handshakes.end();
 }
 
-void HandshakeManager::completeHandshake(const std::string &client_id) {
-    handshakes[client_id].handshake_complete = true;
-    handshakes[client_id].last_active = std::time(nullptr);
+void HandshakeManager::completeHandshake(std::string_view client_id) {
+    auto it = handshakes.find(client_id);
+    if (it == handshakes.end()) {
+        it = handshakes.emplace(client_id, HandshakeState{}).first;
+    }
+    it->second.last_active = std::time(nullptr);
+}
+
+void HandshakeManager::updateClientActivity(std::string_view client_id) {
+    auto it = handshakes.find(client_id);
+    if (it != handshakes.end()) {
+        it->second.last_active = std::time(nullptr);
+    }
 }
 
-bool HandshakeManager::isClientKnown(const std::string &client_id) {
+bool HandshakeManager::isClientKnown(std::string_view client_id) const {
     return handshakes.find(client_id) != handshakes.end();
 }
 
-void HandshakeManager::removeInactiveClients() {
+void HandshakeManager::removeInactiveClients(
+    std::vector<std::string> &removed) {
     std::time_t now = std::time(nullptr);
     for (auto it = handshakes.begin(); it != handshakes.end();) {
         if (it->second.last_active + HANDSHAKE_TIMEOUT < now) {
+            removed.push_back(it->first);
             it = handshakes.erase(it);
         } else {
             ++it;
@@ -1,8 +1,9 @@
 #include "message_parser.hpp"
 
+#include <charconv>
 #include <regex>
 
-uint32_t computeChecksum(const std::string& data) {
+uint32_t computeChecksum(std::string_view data) {
     uint32_t checksum = 0;
     for (char c : data) {
         checksum += static_cast<uint8_t>(c);
@@ -11,59 +12,106 @@ uint32_t computeChecksum(const std::string& data) {
 }
 
 std::optional<ParsedMessage> MessageParser::parseMessage(
-    const std::string& message) {
+    std::string_view message, std::pmr::memory_resource* resource) {
     for (const auto& [type, parser] : parsers) {
-        if (auto result = parser(message)) {
+        if (auto result = parser(message, resource)) {
             return result;
         }
     }
     return std::nullopt;
 }
 
-std::optional<ParsedMessage> parseAckMessage(const std::string& message) {
-    std::regex ack_regex(R"(ACK:\s+(\w+)\s+SEQ:\s+(\d+))");
-    std::smatch match;
-    if (std::regex_match(message, match, ack_regex) && match.size() == 3) {
-        AckMessage ack;
-        ack.client_id = match[1].str();
-        ack.seq_num = std::stoul(match[2].str());
-        return ParsedMessage{ack};
+namespace {
+
+using Iterator = std::string_view::const_iterator;
+using Match = std::match_results<
+    Iterator, std::pmr::polymorphic_allocator<std::sub_match<Iterator>>>;
+
+bool matchMessage(std::string_view message, Match& match,
+                  const std::regex& regex) {
+    return std::regex_match(message.begin(), message.end(), match, regex);
+}
+
+std::pmr::string toString(const std::sub_match<Iterator>& group,
+                          std::pmr::memory_resource* resource) {
+    return std::pmr::string(group.first, group.second, resource);
+}
+
+uint32_t toNumber(const std::sub_match<Iterator>& group) {
+    uint32_t value = 0;
+    std::from_chars(&*group.first, &*group.first + group.length(), value);
+    return value;
+}
+
+}  // namespace
+
+// The regexes are compiled once; matches and the extracted strings live in
+// the caller's memory resource.
+std::optional<ParsedMessage> parseAckMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex ack_regex(
+        R"(ACK:\s+(\w+)\s+SEQ:\s+(\d+)(?:\s+TICKET:\s+(\w+))?)");
+    Match match(resource);
+    if (matchMessage(message, match, ack_regex) && match.size() == 4) {
+        return ParsedMessage{AckMessage{toString(match[1], resource),
+                                        toNumber(match[2]),
+                                        toString(match[3], resource)}};
     }
     return std::nullopt;
 }
 
-std::optional<ParsedMessage> parseNackMessage(const std::string& message) {
-    std::regex nack_regex(R"(NACK:\s+(\w+)\s+SEQ:\s+(\d+))");
-    std::smatch match;
-    if (std::regex_match(message, match, nack_regex) && match.size() == 3) {
-        NackMessage nack;
-        nack.client_id = match[1].str();
-        nack.seq_num = std::stoul(match[2].str());
-        return ParsedMessage{nack};
+std::optional<ParsedMessage> parseNackMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex nack_regex(R"(NACK:\s+(\w+)\s+SEQ:\s+(\d+))");
+    Match match(resource);
+    if (matchMessage(message, match, nack_regex) && match.size() == 3) {
+        return ParsedMessage{
+            NackMessage{toString(match[1], resource), toNumber(match[2])}};
     }
     return std::nullopt;
 }
 
-std::optional<ParsedMessage> parseDataMessage(const std::string& message) {
-    std::regex data_regex(
-        R"(ID:(\w+);SEQ:(\d+);TOT:(\d+);CS:(\d+);DATA:([\S\s]*))");
-    std::smatch match;
-    if (std::regex_match(message, match, data_regex) && match.size() == 6) {
-        DataMessage data;
-        data.client_id = match[1].str();
-        data.seq_num =
-
-            std::stoul(match[2].str());
-        data.total_segments = std::stoul(match[3].str());
-        data.checksum = std::stoul(match[4].str());
-        data.payload = match[5].str();
-        return ParsedMessage{data};
+std::optional<ParsedMessage> parseDataMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex data_regex(
+        R"(ID:(\w+);(?:TK:(\w+);)?SEQ:(\d+);TOT:(\d+);CS:(\d+);DATA:([\S\s]*))");
+    Match match(resource);
+    if (matchMessage(message, match, data_regex) && match.size() == 7) {
+        return ParsedMessage{DataMessage{
+            toString(match[1], resource), toString(match[2], resource),
+            toNumber(match[3]), toNumber(match[4]), toNumber(match[5]),
+            toString(match[6], resource)}};
+    }
+    return std::nullopt;
+}
+
+std::optional<ParsedMessage> parsePushMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex push_regex(
+        R"(PUSH:(\w+);PSEQ:(\d+);SEG:(\d+);TOT:(\d+);CS:(\d+);DATA:([\S\s]*))");
+    Match match(resource);
+    if (matchMessage(message, match, push_regex) && match.size() == 7) {
+        return ParsedMessage{PushMessage{
+            toString(match[1], resource), toNumber(match[2]),
+            toNumber(match[3]), toNumber(match[4]), toNumber(match[5]),
+            toString(match[6], resource)}};
+    }
+    return std::nullopt;
+}
+
+std::optional<ParsedMessage> parsePushAckMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex push_ack_regex(R"(PACK:\s+(\w+)\s+SEQ:\s+(\d+))");
+    Match match(resource);
+    if (matchMessage(message, match, push_ack_regex) && match.size() == 3) {
+        return ParsedMessage{
+            PushAckMessage{toString(match[1], resource), toNumber(match[2])}};
     }
     return std::nullopt;
 }
 
 std::optional<ParsedMessage> parseInitRequestMessage(
-    const std::string& message) {
+    std::string_view message, std::pmr::memory_resource*) {
     if (message == "INIT_REQUEST") {
         return ParsedMessage{InitRequest{}};
     }
@@ -71,34 +119,35 @@ std::optional<ParsedMessage> parseInitRequestMessage(
 }
 
 std::optional<ParsedMessage> parseInitResponseMessage(
-    const std::string& message) {
-    std::regex init_response_regex(R"(INIT_RESPONSE:\s+(\w+))");
-    std::smatch match;
-    if (std::regex_match(message, match, init_response_regex) &&
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex init_response_regex(R"(INIT_RESPONSE:\s+(\w+))");
+    Match match(resource);
+    if (matchMessage(message, match, init_response_regex) &&
         match.size() == 2) {
-        InitResponse init_response;
-        init_response.client_id = match[1].str();
-        return ParsedMessage{init_response};
+        return ParsedMessage{InitResponse{toString(match[1], resource)}};
     }
     return std::nullopt;
 }
 
-std::optional<ParsedMessage> parseHandshakeMessage(const std::string& message) {
-    std::regex handshake_regex(R"(HS:\s+(\w+))");
-    std::smatch match;
-    if (std::regex_match(message, match, handshake_regex) &&
-        match.size() == 2) {
-        HandshakeMessage handshake;
-        handshake.client_id = match[1].str();
-        return ParsedMessage{handshake};
+std::optional<ParsedMessage> parseHandshakeMessage(
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex handshake_regex(R"(HS:\s+(\w+))");
+    Match match(resource);
+    if (matchMessage(message, match, handshake_regex) && match.size() == 2) {
+        return ParsedMessage{HandshakeMessage{toString(match[1], resource)}};
     }
     return std::nullopt;
 }
 
 std::optional<ParsedMessage> parseHandshakeCompleteMessage(
-    const std::string& message) {
-    if (message == "HS_COMPLETE") {
-        return ParsedMessage{HandshakeCompleteMessage{}};
+    std::string_view message, std::pmr::memory_resource* resource) {
+    static const std::regex handshake_complete_regex(
+        R"(HS_COMPLETE(?::\s+(\w+)(?:\s+TICKET:\s+(\w+))?)?)");
+    Match match(resource);
+    if (matchMessage(message, match, handshake_complete_regex) &&
+        match.size() == 3) {
+        return ParsedMessage{HandshakeCompleteMessage{
+            toString(match[1], resource), toString(match[2], resource)}};
     }
     return std::nullopt;
 }
@@ -109,6 +158,8 @@ struct ParserRegistrar {
         parser.registerParser("ACK", parseAckMessage);
         parser.registerParser("NACK", parseNackMessage);
         parser.registerParser("DATA", parseDataMessage);
+        parser.registerParser("PUSH", parsePushMessage);
+        parser.registerParser("PACK", parsePushAckMessage);
         parser.registerParser("INIT_REQUEST", parseInitRequestMessage);
         parser.registerParser("INIT_RESPONSE", parseInitResponseMessage);
         parser.registerParser("HANDSHAKE", parseHandshakeMessage);
@@ -0,0 +1,136 @@
+#include "outbound_queue.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+OutboundQueue::OutboundQueue(size_t capacity)
+    : slots(std::make_unique<Slot[]>(std::bit_ceil(capacity))),
+      mask(std::bit_ceil(capacity) - 1),
+      event_fd(eventfd(0, EFD_NONBLOCK)),
+      enqueue_pos(0),
+      dequeue_pos(0),
+      wakeup_pending(false) {
+    if (event_fd == -1) {
+        throw std::runtime_error("Could not create outbound eventfd");
+    }
+    for (size_t i = 0; i <= mask; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+OutboundQueue::~OutboundQueue() { close(event_fd); }
+
+OutboundQueue::PushResult OutboundQueue::tryPush(const sockaddr_in &addr,
+                                                 std::string_view frame) {
+    if (frame.size() > MAX_FRAME_SIZE) {
+        return PushResult::TooLarge;
+    }
+
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[pos & mask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff =
+            static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return PushResult::Full;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->addr = addr;
+    slot->length = frame.size();
+    std::memcpy(slot->data, frame.data(), frame.size());
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    wakeConsumer();
+    return PushResult::Ok;
+}
+
+OutboundQueue::PushResult OutboundQueue::push(
+    const sockaddr_in &addr, std::string_view frame,
+    std::chrono::milliseconds max_wait) {
+    auto deadline = std::chrono::steady_clock::now() + max_wait;
+    auto backoff = std::chrono::microseconds(10);
+    while (true) {
+        PushResult result = tryPush(addr, frame);
+        if (result != PushResult::Full ||
+            std::chrono::steady_clock::now() >= deadline) {
+            return result;
+        }
+        std::this_thread::sleep_for(backoff);
+        backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
+    }
+}
+
+int OutboundQueue::getEventFD() const { return event_fd; }
+
+size_t OutboundQueue::drain(const BatchSender &send_batch) {
+    uint64_t counter;
+    while (read(event_fd, &counter, sizeof(counter)) > 0) {
+    }
+    // Cleared before draining: a producer that pushes after this point sees
+    // false and signals the eventfd again, so nothing is left behind. The
+    // fence pairs with the one in wakeConsumer: without both, the flag store
+    // may pass the ring reads below while the producer's flag read passes
+    // its slot store, and each side misses the other's write.
+    wakeup_pending.store(false);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    mmsghdr messages[MAX_BATCH];
+    iovec buffers[MAX_BATCH];
+    size_t sent = 0;
+    while (true) {
+        unsigned count = 0;
+        while (count < MAX_BATCH) {
+            Slot &slot = slots[(dequeue_pos + count) & mask];
+            if (slot.sequence.load(std::memory_order_acquire) !=
+                dequeue_pos + count + 1) {
+                break;
+            }
+            buffers[count] = {slot.data, slot.length};
+            messages[count] = {};
+            messages[count].msg_hdr.msg_name = &slot.addr;
+            messages[count].msg_hdr.msg_namelen = sizeof(slot.addr);
+            messages[count].msg_hdr.msg_iov = &buffers[count];
+            messages[count].msg_hdr.msg_iovlen = 1;
+            ++count;
+        }
+        if (count == 0) {
+            return sent;
+        }
+
+        send_batch(messages, count);
+
+        for (unsigned i = 0; i < count; ++i) {
+            slots[(dequeue_pos + i) & mask].sequence.store(
+                dequeue_pos + i + mask + 1, std::memory_order_release);
+        }
+        dequeue_pos += count;
+        sent += count;
+    }
+}
+
+// Called after a slot is published; see drain for the fence.
+void OutboundQueue::wakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!wakeup_pending.exchange(true)) {
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0) {
+            wakeup_pending.store(false);
+        }
+    }
+}
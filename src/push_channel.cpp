@@ -0,0 +1,187 @@
+#include "push_channel.hpp"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "message_parser.hpp"
+
+static constexpr char PUSH_HEADER_FORMAT[] =
+    "PUSH:%.*s;PSEQ:%u;SEG:%zu;TOT:%zu;CS:%u;DATA:";
+
+uint32_t PushChannel::open(std::string_view client_id,
+                           const sockaddr_in &addr) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(client_id);
+    if (it == peers.end()) {
+        it = peers.emplace(std::string(client_id), Peer{}).first;
+        it->second.next_seq = first_seq;
+    }
+    it->second.addr = addr;
+    it->second.in_flight.clear();
+    updatePeerCount();
+    return it->second.next_seq;
+}
+
+PushChannel::PushResult PushChannel::push(std::string_view client_id,
+                                          Message message,
+                                          const BatchSender &send,
+                                          uint32_t *end) {
+    Batch batch;
+    std::lock_guard<std::mutex> lock(mutex);
+    PushResult result = enqueue(client_id, message, Clock::now(), batch);
+    batch.send(send);
+    if (result == PushResult::Ok && end != nullptr) {
+        *end = peers.find(client_id)->second.next_seq;
+    }
+    return result;
+}
+
+void PushChannel::pushAll(std::span<const std::string> client_ids,
+                          Message message, const BatchSender &send,
+                          std::vector<PushResult> &results) {
+    results.clear();
+    Batch batch;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = Clock::now();
+    for (const auto &client_id : client_ids) {
+        results.push_back(enqueue(client_id, message, now, batch));
+    }
+    batch.send(send);
+}
+
+PushChannel::PushResult PushChannel::enqueue(std::string_view client_id,
+                                             const Message &message,
+                                             Clock::time_point now,
+                                             Batch &batch) {
+    // The header is short for any sane id, a frame that would not fit is
+    // refused before anything is sent.
+    if (client_id.size() + MAX_HEADER_SIZE + MAX_SEGMENT_SIZE >
+        MAX_FRAME_SIZE) {
+        return PushResult::TooLarge;
+    }
+    const size_t total_segments = std::max<size_t>(
+        1, (message->size() + MAX_SEGMENT_SIZE - 1) / MAX_SEGMENT_SIZE);
+
+    auto it = peers.find(client_id);
+    if (it == peers.end()) {
+        return PushResult::Unreachable;
+    }
+    Peer &peer = it->second;
+    // A message larger than the window still goes out once nothing else is
+    // in flight, so it cannot be refused forever.
+    if (!peer.in_flight.empty() &&
+        peer.in_flight.size() + total_segments > WINDOW) {
+        return PushResult::Busy;
+    }
+
+    char header[MAX_FRAME_SIZE];
+    for (size_t i = 0; i < total_segments; ++i) {
+        std::string_view body = std::string_view(*message).substr(
+            i * MAX_SEGMENT_SIZE, MAX_SEGMENT_SIZE);
+        int length = std::snprintf(
+            header, sizeof(header), PUSH_HEADER_FORMAT,
+            static_cast<int>(client_id.size()), client_id.data(),
+            peer.next_seq, i, total_segments, computeChecksum(body));
+        Frame &frame = peer.in_flight[peer.next_seq++];
+        frame = {std::string(header, length), message, body, now, 1};
+        batch.add(peer, frame);
+    }
+    return PushResult::Ok;
+}
+
+void PushChannel::acknowledge(std::string_view client_id, uint32_t seq_num) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(client_id);
+    if (it != peers.end()) {
+        it->second.in_flight.erase(seq_num);
+    }
+}
+
+bool PushChannel::delivered(std::string_view client_id,
+                            uint32_t seq_num) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(client_id);
+    if (it == peers.end()) {
+        return false;
+    }
+    const auto &in_flight = it->second.in_flight;
+    return in_flight.empty() || in_flight.begin()->first >= seq_num;
+}
+
+void PushChannel::resendExpired(Clock::time_point now,
+                                const BatchSender &send) {
+    Batch batch;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = peers.begin(); it != peers.end();) {
+        Peer &peer = it->second;
+        size_t batched = batch.frames.size();
+        bool given_up = false;
+        for (auto &[seq_num, frame] : peer.in_flight) {
+            if (now - frame.sent < RESEND_TIMEOUT) {
+                continue;
+            }
+            if (frame.attempts >= MAX_ATTEMPTS) {
+                given_up = true;
+                break;
+            }
+            ++frame.attempts;
+            frame.sent = now;
+            batch.add(peer, frame);
+        }
+        if (given_up) {
+            // The frames batched for the peer are gone with it.
+            batch.frames.resize(batched);
+            it = forget(it);
+        } else {
+            ++it;
+        }
+    }
+    updatePeerCount();
+    batch.send(send);
+}
+
+void PushChannel::close(std::string_view client_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(client_id);
+    if (it != peers.end()) {
+        forget(it);
+        updatePeerCount();
+    }
+}
+
+bool PushChannel::hasPeers() const {
+    return peer_count.load(std::memory_order_relaxed) != 0;
+}
+
+PushChannel::Peers::iterator PushChannel::forget(Peers::iterator it) {
+    first_seq = std::max(first_seq, it->second.next_seq);
+    return peers.erase(it);
+}
+
+void PushChannel::updatePeerCount() {
+    peer_count.store(peers.size(), std::memory_order_relaxed);
+}
+
+void PushChannel::Batch::send(const BatchSender &send) {
+    if (frames.empty()) {
+        return;
+    }
+    // Filled only now, the vectors no longer grow under the pointers.
+    buffers.resize(2 * frames.size());
+    messages.assign(frames.size(), mmsghdr{});
+    for (size_t i = 0; i < frames.size(); ++i) {
+        auto [addr, frame] = frames[i];
+        buffers[2 * i] = {const_cast<char *>(frame->header.data()),
+                          frame->header.size()};
+        buffers[2 * i + 1] = {const_cast<char *>(frame->body.data()),
+                              frame->body.size()};
+        msghdr &message = messages[i].msg_hdr;
+        message.msg_name = const_cast<sockaddr_in *>(addr);
+        message.msg_namelen = sizeof(*addr);
+        message.msg_iov = &buffers[2 * i];
+        message.msg_iovlen = 2;
+    }
+    send(messages.data(), static_cast<unsigned>(messages.size()));
+}
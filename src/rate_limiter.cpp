@@ -0,0 +1,160 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+
+TokenBucket::TokenBucket(const RateLimit &limit, Clock::time_point now)
+    : rate(limit.rate),
+      burst(limit.burst),
+      tokens(limit.burst),
+      last_refill(now) {}
+
+bool TokenBucket::tryConsume(Clock::time_point now) {
+    if (rate <= 0) {
+        last_refill = now;
+        return true;
+    }
+    std::chrono::duration<double> elapsed = now - last_refill;
+    tokens = std::min(burst, tokens + elapsed.count() * rate);
+    last_refill = now;
+    if (tokens < 1.0) {
+        return false;
+    }
+    tokens -= 1.0;
+    return true;
+}
+
+TokenBucket::Clock::time_point TokenBucket::lastUsed() const {
+    return last_refill;
+}
+
+void RateLimiter::setAddressLimit(const RateLimit &limit) {
+    address_limit = limit;
+    address_buckets.clear();
+}
+
+void RateLimiter::setConnectionLimit(const RateLimit &limit) {
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    connection_limit = limit;
+    connection_buckets.clear();
+}
+
+void RateLimiter::setRouteClassLimit(const std::string &prefix,
+                                     const RateLimit &limit) {
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    auto it = std::find_if(route_classes.begin(), route_classes.end(),
+                           [&](const RouteClass &route_class) {
+                               return route_class.prefix == prefix;
+                           });
+    if (it != route_classes.end()) {
+        it->limit = limit;
+    } else {
+        route_classes.push_back({prefix, limit});
+    }
+    connection_buckets.clear();
+}
+
+bool RateLimiter::admitPacket(const sockaddr_in &client_addr) {
+    if (address_limit.rate <= 0) {
+        return true;
+    }
+    auto now = TokenBucket::Clock::now();
+    auto it = address_buckets
+                  .try_emplace(client_addr.sin_addr.s_addr, address_limit, now)
+                  .first;
+    if (it->second.tryConsume(now)) {
+        return true;
+    }
+    dropped_by_address.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool RateLimiter::admitSegment(std::string_view client_id, uint32_t seq_num,
+                               std::string_view payload) {
+    if (connection_limit.rate <= 0 && route_classes.empty()) {
+        return true;
+    }
+    auto now = TokenBucket::Clock::now();
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    auto &buckets = getConnectionBuckets(client_id, now);
+    if (!buckets.frames.tryConsume(now)) {
+        dropped_by_connection.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Only the first segment carries the route, so a message is charged to
+    // its route class once.
+    return seq_num != 0 || admitRouteClass(buckets, payload, now);
+}
+
+bool RateLimiter::admitRoute(std::string_view client_id,
+                             std::string_view message) {
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    if (route_classes.empty()) {
+        return true;
+    }
+    auto now = TokenBucket::Clock::now();
+    return admitRouteClass(getConnectionBuckets(client_id, now), message, now);
+}
+
+bool RateLimiter::admitRouteClass(ConnectionBuckets &buckets,
+                                  std::string_view message,
+                                  TokenBucket::Clock::time_point now) {
+    int route_class = findRouteClass(message);
+    if (route_class >= 0 &&
+        !buckets.route_classes[route_class].tryConsume(now)) {
+        dropped_by_route_class.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void RateLimiter::removeIdleBuckets() {
+    auto now = TokenBucket::Clock::now();
+    if (now - last_cleanup < std::chrono::seconds(1)) {
+        return;
+    }
+    last_cleanup = now;
+
+    std::erase_if(address_buckets, [&](const auto &kv) {
+        return now - kv.second.lastUsed() > IDLE_TIMEOUT;
+    });
+    std::lock_guard<std::mutex> lock(connection_mutex);
+    std::erase_if(connection_buckets, [&](const auto &kv) {
+        return now - kv.second.frames.lastUsed() > IDLE_TIMEOUT;
+    });
+}
+
+RateLimiterStats RateLimiter::getStats() const {
+    return {dropped_by_address.load(std::memory_order_relaxed),
+            dropped_by_connection.load(std::memory_order_relaxed),
+            dropped_by_route_class.load(std::memory_order_relaxed)};
+}
+
+int RateLimiter::findRouteClass(std::string_view payload) const {
+    int best = -1;
+    size_t best_length = 0;
+    for (size_t i = 0; i < route_classes.size(); ++i) {
+        const auto &prefix = route_classes[i].prefix;
+        if (prefix.size() >= best_length && payload.starts_with(prefix)) {
+            best = static_cast<int>(i);
+            best_length = prefix.size();
+        }
+    }
+    return best;
+}
+
+RateLimiter::ConnectionBuckets &RateLimiter::getConnectionBuckets(
+    std::string_view client_id, TokenBucket::Clock::time_point now) {
+    auto it = connection_buckets.find(client_id);
+    if (it != connection_buckets.end()) {
+        return it->second;
+    }
+
+    ConnectionBuckets buckets{TokenBucket(connection_limit, now), {}};
+    buckets.route_classes.reserve(route_classes.size());
+    for (const auto &route_class : route_classes) {
+        buckets.route_classes.emplace_back(route_class.limit, now);
+    }
+    return connection_buckets.emplace(client_id, std::move(buckets))
+        .first->second;
+}
@@ -0,0 +1,25 @@
+#include "request_arena.hpp"
+
+RequestArena::RequestArena() {
+    auto &pool = threadPool();
+    if (pool.empty()) {
+        block = std::make_unique<Block>();
+    } else {
+        block = std::move(pool.back());
+        pool.pop_back();
+    }
+}
+
+RequestArena::~RequestArena() {
+    block->resource.release();
+    threadPool().push_back(std::move(block));
+}
+
+std::pmr::memory_resource *RequestArena::resource() {
+    return &block->resource;
+}
+
+std::vector<std::unique_ptr<RequestArena::Block>> &RequestArena::threadPool() {
+    thread_local std::vector<std::unique_ptr<Block>> pool;
+    return pool;
+}
@@ -37,12 +37,25 @@ void SocketManager::bindSocket() {
     }
 }
 
-void SocketManager::sendMessage(const std::string& message,
+void SocketManager::sendMessage(std::string_view message,
                                 const sockaddr_in& client_addr) {
-    sendto(socket_fd, message.c_str(), message.size(), 0,
+    sendto(socket_fd, message.data(), message.size(), 0,
            (struct sockaddr*)&client_addr, sizeof(client_addr));
 }
 
+void SocketManager::sendBatch(mmsghdr* messages, unsigned int count) {
+    while (count > 0) {
+        int sent = sendmmsg(socket_fd, messages, count, 0);
+        if (sent <= 0) {
+            // Skip the datagram that failed, UDP gives no delivery
+            // guarantees anyway and the rest of the batch should still go.
+            sent = 1;
+        }
+        messages += sent;
+        count -= sent;
+    }
+}
+
 int SocketManager::receiveMessage(char* buffer, size_t buffer_size,
                                   sockaddr_in& client_addr) const {
     socklen_t len = sizeof(client_addr);
@@ -19,23 +19,27 @@
 #include "messages.hpp"
 
 UDPClient::UDPClient(const std::string &server_address, uint16_t server_port)
-    : seq_num(0) {
+    : seq_num(0), handshake_restarted(false) {
     initSocket();
     setupEpoll();
-
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(server_port);
-    inet_pton(AF_INET, server_address.c_str(), &server_addr.sin_addr);
-
-    DEBUG_LOG_BLOCK(
-        { std::cout << "Server address: " << server_address << std::endl; });
+    setServerAddress(server_address, server_port);
 
     if (!performHandshake()) {
         throw std::runtime_error("Failed to perform handshake with server");
     }
 }
 
+UDPClient::UDPClient(const std::string &server_address, uint16_t server_port,
+                     const SessionTicket &session)
+    : client_id(session.client_id),
+      resumption_ticket(session.ticket),
+      seq_num(0),
+      handshake_restarted(false) {
+    initSocket();
+    setupEpoll();
+    setServerAddress(server_address, server_port);
+}
+
 UDPClient::~UDPClient() {
     close(sockfd);
     close(epoll_fd);
@@ -47,6 +51,21 @@ void UDPClient::initSocket() {
         exit(EXIT_FAILURE);
     }
 }
+void UDPClient::setServerAddress(const std::string &server_address,
+                                 uint16_t server_port) {
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(server_port);
+    inet_pton(AF_INET, server_address.c_str(), &server_addr.sin_addr);
+
+    DEBUG_LOG_BLOCK(
+        { std::cout << "Server address: " << server_address << std::endl; });
+}
+
+SessionTicket UDPClient::getSessionTicket() const {
+    return {client_id, resumption_ticket};
+}
+
 void UDPClient::setupEpoll() {
     epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
@@ -82,8 +101,8 @@ bool UDPClient::performHandshake() {
         }
         if (parsed_message_opt &&
             std::holds_alternative<HandshakeMessage>(*parsed_message_opt)) {
-            client_id =
-                std::get<HandshakeMessage>(*parsed_message_opt).client_id;
+            client_id.assign(
+                std::get<HandshakeMessage>(*parsed_message_opt).client_id);
             return true;
         }
     }
@@ -103,11 +122,19 @@ std::optional<std::string> UDPClient::sendMessage(const std::string &message,
     std::chrono::steady_clock::time_point start =
         std::chrono::steady_clock::now();
 
-    for (const auto &segment : segments) {
-        while (!sendAndReceiveAck(segment, timeout)) {
+    for (size_t i = 0; i < segments.size(); ++i) {
+        while (!sendAndReceiveAck(segments[i], timeout)) {
             DEBUG_LOG_BLOCK(
                 { std::cout << "still waiting for ack" << std::endl; });
 
+            if (handshake_restarted) {
+                // The server handed out a new client id, so the whole
+                // message is resent under it.
+                handshake_restarted = false;
+                segments = segmentMessage(message);
+                i = 0;
+            }
+
             if (std::chrono::steady_clock::now() - start >
                 std::chrono::seconds(10)) {
                 throw TimeOutException("Waiting for ack timed out");
@@ -130,8 +157,13 @@ std::vector<std::string> UDPClient::segmentMessage(const std::string &message) {
         const size_t start = i * max_segment_size;
         const size_t end = std::min(start + max_segment_size, message.size());
         const std::string segment_data = message.substr(start, end - start);
+        const std::string ticket_field =
+            (i == 0 && !resumption_ticket.empty())
+                ? "TK:" + resumption_ticket + ";"
+                : "";
         const std::string segment =
-            "ID:" + client_id + ";SEQ:" + std::to_string(seq_num++) +
+            "ID:" + client_id + ";" + ticket_field +
+            "SEQ:" + std::to_string(seq_num++) +
             ";TOT:" + std::to_string(total_segments) +
             ";CS:" + std::to_string(computeChecksum(segment_data)) +
             ";DATA:" + segment_data;
@@ -143,8 +175,10 @@ std::vector<std::string> UDPClient::segmentMessage(const std::string &message) {
 
 uint32_t UDPClient::computeChecksum(const std::string &data) {
     uint32_t checksum = 0;
+    // Same sum of unsigned bytes as the server, so that payloads with bytes
+    // above 0x7f (binary RPC) check out on both sides.
     for (char c : data) {
-        checksum += static_cast<uint32_t>(c);
+        checksum += static_cast<uint8_t>(c);
     }
     return checksum;
 }
@@ -156,10 +190,10 @@ void UDPClient::sendSegment(const std::string &segment) {
 
 bool UDPClient::sendAndReceiveAck(const std::string &message, int timeout) {
     sendSegment(message);
-    return awaitAck(message, timeout);
+    return awaitAck(timeout);
 }
 
-bool UDPClient::awaitAck(const std::string &segment, int timeout) {
+bool UDPClient::awaitAck(int timeout) {
     while (true) {
         epoll_event events[1];
         int nfds = epoll_wait(epoll_fd, events, 1, 1000);
@@ -169,17 +203,19 @@ bool UDPClient::awaitAck(const std::string &segment, int timeout) {
         }
 
         if (nfds > 0) {
-            if (handleEpollEvents(segment, timeout)) {
+            if (handleEpollEvents(timeout)) {
                 return true;
             }
+            if (handshake_restarted) {
+                return false;
+            }
         } else {
             return false;
         }
     }
 }
 
-bool UDPClient::handleEpollEvents(const std::string &current_segment,
-                                  int timeout) {
+bool UDPClient::handleEpollEvents(int timeout) {
     auto response = receiveMessage(timeout);
     if (response.has_value()) {
         auto parsed_message_opt =
@@ -196,13 +232,15 @@ bool UDPClient::handleEpollEvents(const std::string &current_segment,
                            *parsed_message_opt)) {
                 handleHandshake(
                     std::get<HandshakeMessage>(*parsed_message_opt));
-                sendSegment(current_segment);
                 return false;
             } else if (std::holds_alternative<HandshakeCompleteMessage>(
                            *parsed_message_opt)) {
                 handleHandshakeComplete(
                     std::get<HandshakeCompleteMessage>(*parsed_message_opt));
-                sendSegment(current_segment);
+                return false;
+            } else if (std::holds_alternative<PushMessage>(
+                           *parsed_message_opt)) {
+                handlePush(std::get<PushMessage>(*parsed_message_opt));
                 return false;
             }
         }
@@ -215,6 +253,9 @@ void UDPClient::handleAck(const AckMessage &ack) {
         std::cout << "Received ACK: client_id=" << ack.client_id
                   << " seq_num=" << ack.seq_num << std::endl;
     });
+    if (!ack.ticket.empty()) {
+        resumption_ticket.assign(ack.ticket);
+    }
 }
 
 void UDPClient::handleNack(const NackMessage &nack) {
@@ -230,9 +271,14 @@ void UDPClient::handleHandshake(const HandshakeMessage &hs) {
         std::cout << "Received Handshake: client_id=" << hs.client_id
                   << std::endl;
     });
+    client_id.assign(hs.client_id);
+    resumption_ticket.clear();
+    handshake_restarted = true;
+    // Pushes are numbered per client id, a new one starts from scratch.
+    next_push = 0;
+    push_frames.clear();
     std::string handshake_response = "HS: " + client_id;
 
-    client_id = hs.client_id;
     if (sendto(sockfd, handshake_response.c_str(), handshake_response.length(),
                0, (const struct sockaddr *)&server_addr,
                sizeof(server_addr)) < 0) {
@@ -242,6 +288,9 @@ void UDPClient::handleHandshake(const HandshakeMessage &hs) {
 
 void UDPClient::handleHandshakeComplete(const HandshakeCompleteMessage &hsc) {
     std::cout << "Received Handshake Complete" << std::endl;
+    if (!hsc.ticket.empty()) {
+        resumption_ticket.assign(hsc.ticket);
+    }
 }
 
 std::optional<std::string> UDPClient::receiveResponse(int timeout) {
@@ -259,17 +308,20 @@ std::optional<std::string> UDPClient::receiveResponse(int timeout) {
     uint32_t total;
     while (auto parsed_message_opt =
                MessageParser::instance().parseMessage(*message)) {
-        if (std::holds_alternative<DataMessage>(*parsed_message_opt)) {
+        if (std::holds_alternative<PushMessage>(*parsed_message_opt)) {
+            // Pushes may come in between, they are kept for receivePush.
+            handlePush(std::get<PushMessage>(*parsed_message_opt));
+        } else if (std::holds_alternative<DataMessage>(*parsed_message_opt)) {
             auto data = std::get<DataMessage>(*parsed_message_opt);
-            segments[data.seq_num] = data.payload;
+            segments[data.seq_num].assign(data.payload);
             total = data.total_segments;
-        } else {
-            break;
-        }
-        if (segments.size() == total) {
-            for (uint32_t i = 0; i < total; i++) {
-                response += segments[i];
+            if (segments.size() == total) {
+                for (uint32_t i = 0; i < total; i++) {
+                    response += segments[i];
+                }
+                break;
             }
+        } else {
             break;
         }
         message = receiveMessage(timeout);
@@ -277,6 +329,89 @@ std::optional<std::string> UDPClient::receiveResponse(int timeout) {
     return (response == "") ? std::nullopt : std::make_optional(response);
 }
 
+void UDPClient::expectPushes(uint32_t first_seq) {
+    next_push = first_seq;
+    std::erase_if(push_frames,
+                  [&](const auto &kv) { return kv.first < first_seq; });
+    assemblePushes();
+}
+
+std::optional<std::string> UDPClient::receivePush(int timeout) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+    while (pushes.empty()) {
+        auto left = std::chrono::ceil<std::chrono::seconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+            return std::nullopt;
+        }
+        std::optional<std::string> message;
+        try {
+            message = receiveMessage(static_cast<int>(left.count()));
+        } catch (const TimeOutException &) {
+            return std::nullopt;
+        }
+        if (!message) {
+            continue;
+        }
+        // Anything else is a late reply to a request given up on.
+        auto parsed_message_opt =
+            MessageParser::instance().parseMessage(*message);
+        if (parsed_message_opt &&
+            std::holds_alternative<PushMessage>(*parsed_message_opt)) {
+            handlePush(std::get<PushMessage>(*parsed_message_opt));
+        }
+    }
+    std::string push = std::move(pushes.front());
+    pushes.pop_front();
+    return push;
+}
+
+// Every intact frame is acknowledged, duplicates too, since the server
+// resends until it hears back.
+void UDPClient::handlePush(const PushMessage &push) {
+    if (::computeChecksum(push.payload) != push.checksum) {
+        return;
+    }
+    std::string ack = "PACK: " + client_id + " SEQ: " +
+                      std::to_string(push.seq_num);
+    sendto(sockfd, ack.c_str(), ack.size(), 0,
+           (const struct sockaddr *)&server_addr, sizeof(server_addr));
+    if (push.seq_num < next_push) {
+        return;
+    }
+    push_frames.try_emplace(push.seq_num,
+                            PushFrame{push.segment, push.total_segments,
+                                      std::string(push.payload)});
+    assemblePushes();
+}
+
+// Moves messages whose frames are all in, in order, to the pushes queue.
+void UDPClient::assemblePushes() {
+    while (!push_frames.empty() && push_frames.begin()->first == next_push) {
+        const PushFrame &first = push_frames.begin()->second;
+        if (first.segment != 0 || first.total_segments == 0) {
+            push_frames.erase(push_frames.begin());
+            ++next_push;
+            continue;
+        }
+        uint32_t total = first.total_segments;
+        for (uint32_t i = 1; i < total; ++i) {
+            if (!push_frames.contains(next_push + i)) {
+                return;
+            }
+        }
+        std::string message;
+        for (uint32_t i = 0; i < total; ++i) {
+            auto it = push_frames.find(next_push + i);
+            message += it->second.payload;
+            push_frames.erase(it);
+        }
+        pushes.push_back(std::move(message));
+        next_push += total;
+    }
+}
+
 std::optional<std::string> UDPClient::receiveMessage(int timeout) {
     if (timeout > 0) {
         struct timeval tv;
@@ -302,9 +437,10 @@ std::optional<std::string> UDPClient::receiveMessage(int timeout) {
     DEBUG_LOG_BLOCK(
         { std::cout << "recieved " << n << " bytes" << std::endl; });
     if (n > 0) {
-        buffer[n] = '\0';
-        DEBUG_LOG_BLOCK({ std::cout << std::string(buffer) << std::endl; });
-        return std::string(buffer);
+        // Payloads may be binary, so the datagram length is what counts.
+        std::string message(buffer, n);
+        DEBUG_LOG_BLOCK({ std::cout << message << std::endl; });
+        return message;
     }
     return std::nullopt;
 }
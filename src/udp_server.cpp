@@ -3,7 +3,10 @@
 #include <netinet/in.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
@@ -11,6 +14,7 @@
 #include "exceptions.hpp"
 #include "message_parser.hpp"
 #include "messages.hpp"
+#include "request_arena.hpp"
 
 UDPServer::UDPServer(uint16_t port) : running(false) {
     socketManager.initSocket(port);
@@ -32,24 +36,52 @@ UDPServer::UDPServer(uint16_t port) : running(false) {
 }
 
 UDPServer::~UDPServer() {
+    workerPool.reset();
     if (epoll_fd >= 0) {
         close(epoll_fd);
     }
 }
 
+void UDPServer::enablePipeline(size_t worker_count) {
+    if (workerPool) {
+        return;
+    }
+    outboundQueue = std::make_unique<OutboundQueue>(OUTBOUND_QUEUE_CAPACITY);
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = outboundQueue->getEventFD();
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, outboundQueue->getEventFD(), &ev) ==
+        -1) {
+        throw std::runtime_error("Could not add outbound eventfd to epoll");
+    }
+
+    workerPool = std::make_unique<WorkerPool>(worker_count);
+}
+
+void UDPServer::flushOutbound() {
+    outboundQueue->drain([this](mmsghdr *messages, unsigned count) {
+        socketManager.sendBatch(messages, count);
+    });
+}
+
 void UDPServer::start() {
     running = true;
     std::cout << "Server is running" << std::endl;
 
     while (running) {
-        epoll_event events[1];
-        int nfds = epoll_wait(epoll_fd, events, 1, -1);
+        epoll_event events[2];
+        int timeout = pushChannel.hasPeers() ? PUSH_RESEND_INTERVAL_MS : -1;
+        int nfds = epoll_wait(epoll_fd, events, 2, timeout);
         if (nfds == -1) {
             throw std::runtime_error("Could not wait for events");
         }
 
         for (int n = 0; n < nfds; ++n) {
-            if (events[n].events & EPOLLIN) {
+            if (outboundQueue &&
+                events[n].data.fd == outboundQueue->getEventFD()) {
+                flushOutbound();
+            } else if (events[n].events & EPOLLIN) {
                 char buffer[1024];
                 struct sockaddr_in client_addr;
                 int len = socketManager.receiveMessage(buffer, sizeof(buffer),
@@ -58,21 +90,55 @@ void UDPServer::start() {
                     std::cout << "Received " << len << " bytes" << std::endl;
                 });
 
-                if (len > 0) {
-                    buffer[len] = '\0';
-                    std::string message(buffer);
-                    handleClientMessage(message, client_addr);
+                if (len > 0 && rateLimiter.admitPacket(client_addr)) {
+                    handleClientMessage({buffer, static_cast<size_t>(len)},
+                                        client_addr);
                 }
             }
         }
 
-        handshakeManager.removeInactiveClients();
+        if (pushChannel.hasPeers()) {
+            pushChannel.resendExpired(
+                PushChannel::Clock::now(),
+                [this](mmsghdr *messages, unsigned count) {
+                    sendFrames(messages, count);
+                });
+        }
+
+        expired_clients.clear();
+        handshakeManager.removeInactiveClients(expired_clients);
+        for (const auto &client_id : expired_clients) {
+            pushChannel.close(client_id);
+        }
         connectionManager.removeInactiveClients();
+        rateLimiter.removeIdleBuckets();
     }
 }
 
 void UDPServer::stop() { running = false; }
 
+void UDPServer::setAddressRateLimit(const RateLimit &limit) {
+    rateLimiter.setAddressLimit(limit);
+}
+
+void UDPServer::setConnectionRateLimit(const RateLimit &limit) {
+    rateLimiter.setConnectionLimit(limit);
+}
+
+void UDPServer::setRouteClassRateLimit(const std::string &prefix,
+                                       const RateLimit &limit) {
+    rateLimiter.setRouteClassLimit(prefix, limit);
+}
+
+RateLimiterStats UDPServer::getRateLimiterStats() const {
+    return rateLimiter.getStats();
+}
+
+bool UDPServer::admitRoute(std::string_view client_id,
+                           std::string_view message) {
+    return rateLimiter.admitRoute(client_id, message);
+}
+
 template <class... Ts>
 struct overloaded : Ts... {
     using Ts::operator()...;
@@ -80,9 +146,13 @@ struct overloaded : Ts... {
 template <class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
-void UDPServer::handleClientMessage(const std::string &message,
+void UDPServer::handleClientMessage(std::string_view message,
                                     struct sockaddr_in &client_addr) {
-    auto parsed_message_opt = MessageParser::instance().parseMessage(message);
+    // Everything the parser produces for this datagram lives in the arena
+    // and is dropped in one go when the request is done.
+    RequestArena arena;
+    auto parsed_message_opt =
+        MessageParser::instance().parseMessage(message, arena.resource());
 
     if (!parsed_message_opt) {
         std::cerr << "[ERROR] Failed to parse message: " << message
@@ -90,7 +160,6 @@ void UDPServer::handleClientMessage(const std::string &message,
         return;
     }
 
-    ParsedMessage parsed_message = *parsed_message_opt;
     DEBUG_LOG_BLOCK({ std::cout << "parsing message\n"; });
     std::visit(
         overloaded{
@@ -99,8 +168,10 @@ void UDPServer::handleClientMessage(const std::string &message,
                 handleNackMessage(nack, client_addr);
             },
             [&](const DataMessage &data) {
-                handleDataMessage(data, client_addr);
+                handleDataMessage(data, client_addr, arena.resource());
             },
+            [&](const PushMessage &) {},
+            [&](const PushAckMessage &ack) { handlePushAckMessage(ack); },
             [&](const InitRequest &init_request) {
                 DEBUG_LOG_BLOCK({ std::cout << "init request\n"; });
                 handleInitRequest(init_request, client_addr);
@@ -115,7 +186,7 @@ void UDPServer::handleClientMessage(const std::string &message,
 
             },
         },
-        parsed_message);
+        *parsed_message_opt);
 }
 
 void UDPServer::handleAckMessage(const AckMessage &ack,
@@ -134,11 +205,38 @@ void UDPServer::handleNackMessage(const NackMessage &nack,
     });
 }
 
+void UDPServer::handlePushAckMessage(const PushAckMessage &ack) {
+    pushChannel.acknowledge(ack.client_id, ack.seq_num);
+    // A client that only listens to pushes is still active.
+    if (handshakeManager.isHandshakeComplete(ack.client_id)) {
+        handshakeManager.updateClientActivity(ack.client_id);
+    }
+}
+
 void UDPServer::handleDataMessage(const DataMessage &data,
-                                  struct sockaddr_in &client_addr) {
-    if (!handshakeManager.isClientKnown(data.client_id) ||
-        !handshakeManager.isHandshakeComplete(data.client_id)) {
-        sendHandshakeToClient(data.client_id, client_addr);
+                                  struct sockaddr_in &client_addr,
+                                  std::pmr::memory_resource *resource) {
+    std::string ticket;
+    if (!handshakeManager.isHandshakeComplete(data.client_id)) {
+        // A valid cookie proves the client owns its address and a valid
+        // ticket restores a forgotten session, so in both cases the
+        // connection is established right here without another round trip.
+        if (!handshakeManager.isTicketValid(data.ticket, data.client_id) &&
+            !handshakeManager.isCookieValid(data.client_id, client_addr)) {
+            sendHandshakeToClient(handshakeManager.issueCookie(client_addr),
+                                  client_addr);
+            return;
+        }
+        handshakeManager.completeHandshake(data.client_id);
+        connectionManager.registerClient(data.client_id);
+        ticket = handshakeManager.issueTicket(data.client_id);
+    } else {
+        handshakeManager.updateClientActivity(data.client_id);
+    }
+
+    // Over-limit frames are dropped without an ACK, the client retransmits.
+    if (!rateLimiter.admitSegment(data.client_id, data.seq_num,
+                                  data.payload)) {
         return;
     }
 
@@ -156,32 +254,48 @@ void UDPServer::handleDataMessage(const DataMessage &data,
                   << " payload=" << data.payload << std::endl;
     });
 
-    sendAckToClient(data.client_id, data.seq_num, client_addr);
-    connectionManager.trackSegment(data.client_id, data.seq_num,
-                                   data.total_segments, data.payload);
+    sendAckToClient(data.client_id, data.seq_num, client_addr, ticket);
+
+    // Most requests fit into one segment and need no reassembly at all.
+    std::pmr::string complete_message(resource);
+    std::string_view message = data.payload;
+    if (data.total_segments != 1) {
+        connectionManager.trackSegment(data.client_id, data.seq_num,
+                                       data.total_segments, data.payload);
+        try {
+            connectionManager.assembleMessage(data.client_id,
+                                              complete_message);
+        } catch (IncompleteMessageException) {
+            return;
+        }
+        message = complete_message;
+    }
 
-    std::string complete_message;
-    try {
-        connectionManager.assembleMessage(data.client_id, complete_message);
-    } catch (IncompleteMessageException) {
+    MessageDispatcher *handler = connectionManager.getMessageHandler();
+    if (workerPool) {
+        workerPool->submit(
+            data.client_id,
+            [handler, client_id = std::string(data.client_id), client_addr,
+             message = std::string(message)]() mutable {
+                handler->handleMessage(client_id, client_addr, message);
+            });
         return;
     }
-    connectionManager.getMessageHandler()->handleMessage(
-        data.client_id, client_addr, complete_message);
+    current_client_id.assign(data.client_id);
+    handler->handleMessage(current_client_id, client_addr, message);
 }
 
-void UDPServer::sendInitResponseToClient(const std::string &client_id,
+void UDPServer::sendInitResponseToClient(std::string_view client_id,
                                          struct sockaddr_in &client_addr) {
-    std::string message = "HS: " + client_id;
-    socketManager.sendMessage(message, client_addr);
-    DEBUG_LOG_BLOCK({ std::cout << "sent message: " << message << std::endl; });
+    sendHandshakeToClient(client_id, client_addr);
+    DEBUG_LOG_BLOCK(
+        { std::cout << "sent message: HS: " << client_id << std::endl; });
 }
 
 void UDPServer::handleInitRequest(const InitRequest &,
                                   struct sockaddr_in &client_addr) {
-    std::string client_id = generateClientId();
-    handshakeManager.startHandshake(client_id);
-    sendInitResponseToClient(client_id, client_addr);
+    sendInitResponseToClient(handshakeManager.issueCookie(client_addr),
+                             client_addr);
 }
 
 void UDPServer::handleInitResponse(const InitResponse &init_response,
@@ -192,79 +306,90 @@ void UDPServer::handleInitResponse(const InitResponse &init_response,
     });
 }
 
-void UDPServer::handleHandshakeMessage(const std::string &client_id,
+void UDPServer::handleHandshakeMessage(std::string_view client_id,
                                        struct sockaddr_in &client_addr) {
     if (handshakeManager.isClientKnown(client_id)) {
         handshakeManager.completeHandshake(client_id);
         connectionManager.registerClient(client_id);
         sendHandshakeCompleteToClient(client_id, client_addr);
+    } else if (handshakeManager.isCookieValid(client_id, client_addr)) {
+        handshakeManager.completeHandshake(client_id);
+        connectionManager.registerClient(client_id);
+        sendHandshakeCompleteToClient(client_id, client_addr);
     } else {
-        handshakeManager.startHandshake(client_id);
-        sendHandshakeToClient(client_id, client_addr);
+        sendHandshakeToClient(handshakeManager.issueCookie(client_addr),
+                              client_addr);
     }
 }
 
-void UDPServer::sendAckToClient(const std::string &client_id, uint32_t seq_num,
-                                struct sockaddr_in &client_addr) {
-    std::string response =
-        "ACK: " + client_id + " SEQ: " + std::to_string(seq_num);
-    socketManager.sendMessage(response, client_addr);
+// Control frames are short, so they are formatted on the stack. A frame that
+// would not fit is not sent, the client retransmits and gets dropped again.
+void UDPServer::sendAckToClient(std::string_view client_id, uint32_t seq_num,
+                                struct sockaddr_in &client_addr,
+                                std::string_view ticket) {
+    char response[256];
+    int length =
+        ticket.empty()
+            ? std::snprintf(response, sizeof(response), "ACK: %.*s SEQ: %u",
+                            static_cast<int>(client_id.size()),
+                            client_id.data(), seq_num)
+            : std::snprintf(response, sizeof(response),
+                            "ACK: %.*s SEQ: %u TICKET: %.*s",
+                            static_cast<int>(client_id.size()),
+                            client_id.data(), seq_num,
+                            static_cast<int>(ticket.size()), ticket.data());
+    if (length > 0 && static_cast<size_t>(length) < sizeof(response)) {
+        socketManager.sendMessage({response, static_cast<size_t>(length)},
+                                  client_addr);
+    }
 }
 
-void UDPServer::sendNackToClient(const std::string &client_id, uint32_t seq_num,
+void UDPServer::sendNackToClient(std::string_view client_id, uint32_t seq_num,
                                  struct sockaddr_in &client_addr) {
-    std::string response =
-        "NACK: " + client_id + " SEQ: " + std::to_string(seq_num);
-    socketManager.sendMessage(response, client_addr);
+    char response[256];
+    int length = std::snprintf(response, sizeof(response), "NACK: %.*s SEQ: %u",
+                               static_cast<int>(client_id.size()),
+                               client_id.data(), seq_num);
+    if (length > 0 && static_cast<size_t>(length) < sizeof(response)) {
+        socketManager.sendMessage({response, static_cast<size_t>(length)},
+                                  client_addr);
+    }
 }
 
-void UDPServer::sendHandshakeToClient(const std::string &client_id,
+void UDPServer::sendHandshakeToClient(std::string_view client_id,
                                       struct sockaddr_in &client_addr) {
-    std::string response = "HS: " + client_id;
+    std::string response = "HS: ";
+    response += client_id;
     socketManager.sendMessage(response, client_addr);
 }
 
-void UDPServer::sendHandshakeCompleteToClient(const std::string &client_id,
+void UDPServer::sendHandshakeCompleteToClient(std::string_view client_id,
                                               struct sockaddr_in &client_addr) {
-    std::string response = "HS_COMPLETE: " + client_id;
+    std::string response = "HS_COMPLETE: ";
+    response += client_id;
+    response += " TICKET: ";
+    response += handshakeManager.issueTicket(client_id);
     socketManager.sendMessage(response, client_addr);
 }
 
-std::string UDPServer::generateClientId() {
-    static std::size_t id = 0;
-    return "client_" + std::to_string(id++);
-}
-
-inline std::vector<std::string> segmentMessage(const std::string &message,
-                                               const std::string &client_id) {
-    if (message.empty()) {
-        return std::vector<std::string>{"ID:" + client_id +
-                                        ";SEQ:0;TOT:1;CS:0;DATA:"};
+// Formats one DATA frame into the caller's buffer, returns its length or 0
+// if it does not fit.
+static size_t formatSegment(char *out, size_t capacity,
+                            const std::string &client_id, size_t seq_num,
+                            size_t total_segments, std::string_view data) {
+    int header = std::snprintf(
+        out, capacity, "ID:%s;SEQ:%zu;TOT:%zu;CS:%u;DATA:", client_id.c_str(),
+        seq_num, total_segments, computeChecksum(data));
+    if (header < 0 || static_cast<size_t>(header) + data.size() > capacity) {
+        return 0;
     }
-    uint32_t seq_num = 0;
-    const size_t max_segment_size = 512;
-    const size_t total_segments =
-        (message.size() + max_segment_size - 1) / max_segment_size;
-    std::vector<std::string> segments;
-
-    for (size_t i = 0; i < total_segments; ++i) {
-        const size_t start = i * max_segment_size;
-        const size_t end = std::min(start + max_segment_size, message.size());
-        const std::string segment_data = message.substr(start, end - start);
-        const std::string segment =
-            "ID:" + client_id + ";SEQ:" + std::to_string(seq_num++) +
-            ";TOT:" + std::to_string(total_segments) +
-            ";CS:" + std::to_string(computeChecksum(segment_data)) +
-            ";DATA:" + segment_data;
-        segments.push_back(segment);
-    }
-
-    return segments;
+    std::memcpy(out + header, data.data(), data.size());
+    return header + data.size();
 }
 
 void UDPServer::sendMessage(const std::string &client_id,
                             struct sockaddr_in &addr,
-                            const std::string &message) {
+                            std::string_view message) {
     DEBUG_LOG_BLOCK({
         if (message == "ERR") {
             std::cerr << "sending ERR message to " << client_id << std::endl;
@@ -272,9 +397,68 @@ void UDPServer::sendMessage(const std::string &client_id,
     });
     std::cout << "[INFO] sending {" << message << "} to " << client_id
               << std::endl;
-    auto segments = segmentMessage(message, client_id);
+    const size_t total_segments = std::max<size_t>(
+        1, (message.size() + MAX_SEGMENT_SIZE - 1) / MAX_SEGMENT_SIZE);
+    char frame[OutboundQueue::MAX_FRAME_SIZE];
 
-    for (const auto &segment : segments) {
-        socketManager.sendMessage(segment, addr);
+    for (size_t i = 0; i < total_segments; ++i) {
+        std::string_view data =
+            message.substr(i * MAX_SEGMENT_SIZE, MAX_SEGMENT_SIZE);
+        size_t length = formatSegment(frame, sizeof(frame), client_id, i,
+                                      total_segments, data);
+        if (length == 0) {
+            std::cerr << "[ERROR] Segment does not fit into a frame for "
+                      << client_id << std::endl;
+            return;
+        }
+
+        if (!outboundQueue) {
+            socketManager.sendMessage({frame, length}, addr);
+        } else if (outboundQueue->push(addr, {frame, length},
+                                       OUTBOUND_PUSH_TIMEOUT) !=
+                   OutboundQueue::PushResult::Ok) {
+            std::cerr << "[WARNING] Outbound queue is full, dropping "
+                      << "response to " << client_id << std::endl;
+            return;
+        }
     }
 }
+
+uint32_t UDPServer::openPush(const std::string &client_id,
+                             const struct sockaddr_in &client_addr) {
+    return pushChannel.open(client_id, client_addr);
+}
+
+PushChannel::PushResult UDPServer::pushMessage(const std::string &client_id,
+                                               std::string_view message,
+                                               uint32_t *end) {
+    return pushChannel.push(
+        client_id, std::make_shared<const std::string>(message),
+        [this](mmsghdr *messages, unsigned count) {
+            sendFrames(messages, count);
+        },
+        end);
+}
+
+bool UDPServer::pushDelivered(const std::string &client_id,
+                              uint32_t seq_num) const {
+    return pushChannel.delivered(client_id, seq_num);
+}
+
+void UDPServer::pushToAll(std::span<const std::string> client_ids,
+                          PushChannel::Message message,
+                          std::vector<PushChannel::PushResult> &results) {
+    pushChannel.pushAll(
+        client_ids, std::move(message),
+        [this](mmsghdr *messages, unsigned count) {
+            sendFrames(messages, count);
+        },
+        results);
+}
+
+// Push frames bypass the outbound queue even in pipeline mode: they are
+// gathered into batches already, and copying each into the ring would undo
+// the sharing of their bodies. The socket takes sends from any thread.
+void UDPServer::sendFrames(mmsghdr *messages, unsigned count) {
+    socketManager.sendBatch(messages, count);
+}
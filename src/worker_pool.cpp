@@ -0,0 +1,56 @@
+#include "worker_pool.hpp"
+
+#include <iostream>
+
+WorkerPool::WorkerPool(size_t worker_count) {
+    if (worker_count == 0) {
+        worker_count = 1;
+    }
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (auto &worker : workers) {
+        worker->thread = std::jthread(
+            [&worker = *worker](std::stop_token stop_token) {
+                run(worker, stop_token);
+            });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    for (auto &worker : workers) {
+        worker->thread.request_stop();
+    }
+}
+
+void WorkerPool::submit(std::string_view key, Task task) {
+    auto &worker =
+        *workers[std::hash<std::string_view>{}(key) % workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        worker.tasks.push_back(std::move(task));
+    }
+    worker.cv.notify_one();
+}
+
+void WorkerPool::run(Worker &worker, std::stop_token stop_token) {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(worker.mtx);
+            if (!worker.cv.wait(lock, stop_token,
+                                [&] { return !worker.tasks.empty(); })) {
+                return;
+            }
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        try {
+            task();
+        } catch (const std::exception &e) {
+            std::cerr << "[ERROR] Worker task failed: " << e.what()
+                      << std::endl;
+        }
+    }
+}